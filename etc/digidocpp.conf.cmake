@@ -28,13 +28,31 @@
     <!--<param name="tsl.cache" lock="false"></param>-->
     <!--<param name="tsl.onlineDigest" lock="false">true</param>-->
     <!--<param name="tsl.timeOut" lock="false">10</param>-->
+    <!--<param name="tsl.refreshInterval" lock="false">0</param>-->
 
     <!--Verify service settings-->
     <!--<param name="verify.serivceUri" lock="false">@SIVA_URL@</param>-->
 
+    <!--Container document compression settings-->
+    <!--<param name="compression.level" lock="false">-1</param>-->
+    <!--<param name="compression.probe" lock="false">true</param>-->
+    <!--<param name="compression.skip.extension" lock="false">pdf</param>-->
+    <!--<param name="compression.skip.mediaType" lock="false">application/pdf</param>-->
+
+    <!--HTTP connection settings-->
+    <!--<param name="connection.pool.size" lock="false">0</param>-->
+    <!--<param name="connection.pool.idleTimeout" lock="false">30</param>-->
+
+    <!--Worker thread settings-->
+    <!--<param name="threadpool.size" lock="false">0</param>-->
+
     <!--OCSP BDoc-TM validation settings-->
     <!--<param name="ocsp.tm.profile" lock="false">1.3.6.1.4.1.10015.4.1.2</param>-->
 
+    <!--OCSP response cache settings-->
+    <!--<param name="ocsp.cache" lock="false">false</param>-->
+    <!--<param name="ocsp.cache.path" lock="false"></param>-->
+
     <!--OCSP responder URL-->
     <!--<ocsp issuer="ISSUER NAME">http://ocsp.issuer.com</ocsp>-->
 </configuration>
@@ -206,12 +206,17 @@ static std::vector<unsigned char>* SWIG_JavaArrayToVectorUnsignedChar(JNIEnv *je
 %ignore digidoc::Conf::libdigidocConf;
 %ignore digidoc::Conf::certsPath;
 %ignore digidoc::ConfV3::OCSPTMProfiles;
+%ignore digidoc::ConfV6::compressionSkipExtensions;
+%ignore digidoc::ConfV6::compressionSkipMediaTypes;
 %ignore digidoc::Signature::Validator::warnings;
+%ignore digidoc::Signature::Validator::checks;
+%ignore digidoc::Signature::Validator::Check;
 %ignore digidoc::Signature::OCSPNonce;
 // std::unique_ptr is since swig 4.1
 %ignore digidoc::Container::createPtr;
 %ignore digidoc::Container::openPtr;
 %ignore digidoc::Container::extendContainerValidity;
+%ignore digidoc::Container::validateAll;
 
 %newobject digidoc::Container::open;
 %newobject digidoc::Container::create;
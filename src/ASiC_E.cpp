@@ -49,16 +49,18 @@ public:
 /**
  * Initialize BDOC container.
  */
-ASiC_E::ASiC_E(const string &path, bool create) try
+ASiC_E::ASiC_E(const string &path, bool create, const ZipProbe *zip) try
     : ASiContainer(path, MIMETYPE_ASIC_E)
     , d(make_unique<Private>())
 {
     if(create)
         return;
-    auto z = load(true, {MIMETYPE_ASIC_E, MIMETYPE_ADOC});
+    unique_ptr<ZipProbe> owned;
+    if(!zip)
+        zip = (owned = make_unique<ZipProbe>(path)).get();
+    const ZipSerialize &z = load(*zip, true, {MIMETYPE_ASIC_E, MIMETYPE_ADOC});
     auto doc = XMLDocument::open(z.read("META-INF/manifest.xml"), {"manifest", MANIFEST_NS});
-    static const XMLSchema schema(File::path(Conf::instance()->xsdPath(), "OpenDocument_manifest_v1_2.xsd"));
-    doc.validateSchema(schema);
+    doc.validateSchema(XMLSchema::cached(File::path(Conf::instance()->xsdPath(), "OpenDocument_manifest_v1_2.xsd")));
 
     set<string_view> manifestFiles;
     bool mimeFound = false;
@@ -95,7 +97,7 @@ ASiC_E::ASiC_E(const string &path, bool create) try
     if(!mimeFound)
         THROW("Manifest is missing mediatype file entry.");
 
-    for(const string &file: z.list())
+    for(const string &file: zip->list)
     {
         /**
          * http://www.etsi.org/deliver/etsi_ts/102900_102999/102918/01.03.01_60/ts_102918v010301p.pdf
@@ -215,12 +217,35 @@ unique_ptr<Container> ASiC_E::openInternal(const string &path)
     return unique_ptr<Container>(new ASiC_E(path, false));
 }
 
+unique_ptr<Container> ASiC_E::openInternal(const ZipProbe &zip)
+{
+    DEBUG("ASiC_E::openInternal(%s)", zip.z.path().c_str());
+    return unique_ptr<Container>(new ASiC_E(zip.z.path(), false, &zip));
+}
+
 void ASiC_E::loadSignatures(XMLDocument &&doc, const string &file)
 {
     auto signatures = make_shared<Signatures>(std::move(doc), mediaType());
     d->signatures.emplace(file, signatures.get());
     for(auto s = signatures->signature(); s; s++)
+    {
         addSignature(make_unique<SignatureXAdES_LTA>(signatures, s, this));
+        // Calculate referenced digests alongside the first decompression of data files
+        for(auto ref = s/"SignedInfo"/"Reference"; ref; ref++)
+        {
+            auto uri = ref["URI"];
+            if(uri.empty() || uri.front() == '#')
+                continue;
+            string name = File::fromUriPath(uri);
+            if(name.starts_with('/'))
+                name.erase(0, 1);
+            for(DataFile *file: dataFiles())
+            {
+                if(file->fileName() == name)
+                    static_cast<DataFilePrivate*>(file)->addDigestMethod(string((ref/DigestMethod)["Algorithm"]));
+            }
+        }
+    }
 }
 
 Signature* ASiC_E::prepareSignature(Signer *signer)
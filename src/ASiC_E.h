@@ -48,9 +48,10 @@ namespace digidoc
 
           static std::unique_ptr<Container> createInternal(const std::string &path);
           static std::unique_ptr<Container> openInternal(const std::string &path);
+          static std::unique_ptr<Container> openInternal(const ZipProbe &zip);
 
       private:
-          ASiC_E(const std::string &path, bool create);
+          ASiC_E(const std::string &path, bool create, const ZipProbe *zip = nullptr);
           DISABLE_COPY(ASiC_E);
           void canSave() final;
           void loadSignatures(XMLDocument &&doc, const std::string &file);
@@ -33,15 +33,18 @@ using namespace std;
 /**
  * Initialize ASiCS container.
  */
-ASiC_S::ASiC_S(const string &path, bool create)
+ASiC_S::ASiC_S(const string &path, bool create, const ZipProbe *zip)
     : ASiContainer(path, MIMETYPE_ASIC_S)
 {
     if(create)
         return;
-    auto z = load(false, {mediaType()});
+    unique_ptr<ZipProbe> owned;
+    if(!zip)
+        zip = (owned = make_unique<ZipProbe>(path)).get();
+    const ZipSerialize &z = load(*zip, false, {mediaType()});
     bool foundTimestamp = false;
     bool foundManifest = false;
-    for(const string &file: z.list())
+    for(const string &file: zip->list)
     {
         if(file == "mimetype")
             continue;
@@ -127,6 +130,23 @@ unique_ptr<Container> ASiC_S::openInternal(const string &path, ContainerOpenCB *
     return {};
 }
 
+unique_ptr<Container> ASiC_S::openInternal(const ZipProbe &zip)
+{
+    if(util::File::fileExtension(zip.z.path(), {"asice", "sce", "bdoc"}) ||
+        (!zip.mimetype.empty() && zip.mimetype != MIMETYPE_ASIC_S))
+        return {};
+    DEBUG("ASiC_S::openInternal(%s)", zip.z.path().c_str());
+    try
+    {
+        return unique_ptr<Container>(new ASiC_S(zip.z.path(), false, &zip));
+    }
+    catch(const Exception &)
+    {
+        // Ignore the exception: not ASiC-S document
+    }
+    return {};
+}
+
 Signature* ASiC_S::prepareSignature(Signer * /*signer*/)
 {
     THROW("Not implemented.");
@@ -39,9 +39,10 @@ namespace digidoc
 
         static std::unique_ptr<Container> createInternal(const std::string &path);
         static std::unique_ptr<Container> openInternal(const std::string &path, ContainerOpenCB *cb);
+        static std::unique_ptr<Container> openInternal(const ZipProbe &zip);
 
     private:
-        ASiC_S(const std::string &path, bool create);
+        ASiC_S(const std::string &path, bool create, const ZipProbe *zip = nullptr);
         DISABLE_COPY(ASiC_S);
 
         void addDataFileChecks(const std::string &path, const std::string &mediaType) override;
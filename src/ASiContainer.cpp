@@ -19,17 +19,23 @@
 
 #include "ASiContainer.h"
 
+#include "Conf.h"
 #include "DataFile_p.h"
 #include "Signature.h"
 #include "XMLDocument.h"
 #include "util/algorithm.h"
 #include "util/File.h"
+#include "util/ThreadPool.h"
 #include "util/log.h"
 
+#include <algorithm>
 #include <array>
 #include <ctime>
+#include <deque>
 #include <fstream>
+#include <future>
 #include <map>
+#include <set>
 #include <sstream>
 
 using namespace digidoc;
@@ -68,35 +74,63 @@ XMLDocument ASiContainer::createManifest() const
 }
 
 /**
- * Loads Container from a file.
+ * Opens ZIP archive and reads its entry list and mimetype.
  *
  * @param path name of the container file.
+ * @throws Exception if the file is not a ZIP archive or the mimetype can not be read.
+ */
+ZipProbe::ZipProbe(const string &path)
+    : z(path, false)
+    , list(z.list())
+    , mimetype(contains(list, "mimetype") ? z.mimetype() : string())
+{}
+
+/**
+ * Probes the file for ZIP local file header signature before opening the archive.
+ *
+ * @param path name of the container file.
+ * @return returns opened archive, nullptr if the file is not a readable ZIP archive.
+ */
+unique_ptr<ZipProbe> ZipProbe::open(const string &path)
+{
+    array<char,4> magic{};
+    if(ifstream is(File::encodeName(path), ifstream::binary);
+        !is.read(magic.data(), magic.size()) || magic != array<char,4>{'P', 'K', 3, 4})
+        return {};
+    try {
+        return make_unique<ZipProbe>(path);
+    } catch(const Exception &) {
+        return {};
+    }
+}
+
+/**
+ * Loads Container from an opened ZIP archive.
+ *
+ * @param zip opened archive of the container file.
  * @param mimetypeRequired flag indicating if the mimetype must be present and checked.
  * @param supported supported mimetypes.
  * @return returns zip serializer for the container.
  */
-ZipSerialize ASiContainer::load(bool mimetypeRequired, const set<string_view> &supported)
+const ZipSerialize& ASiContainer::load(const ZipProbe &zip, bool mimetypeRequired, const set<string_view> &supported)
 {
     DEBUG("ASiContainer::ASiContainer(path = '%s')", d->path.c_str());
-    ZipSerialize z(d->path, false);
-    vector<string> list = z.list();
-
     // ETSI TS 102 918: mimetype has to be the first in the archive
-    if(mimetypeRequired && list.front() != "mimetype")
+    if(mimetypeRequired && zip.list.front() != "mimetype")
         THROW("required mimetype not found");
 
-    if(list.front() == "mimetype")
+    if(zip.list.front() == "mimetype")
     {
-        d->mimetype = z.mimetype();
+        d->mimetype = zip.mimetype;
         if(!contains(supported, d->mimetype))
             THROW("Incorrect mimetype '%s'", d->mimetype.c_str());
     }
     DEBUG("mimetype = '%s'", d->mimetype.c_str());
 
-    for(const string &file: list)
-        d->properties[file] = z.properties(file);
+    for(const string &file: zip.list)
+        d->properties[file] = zip.z.properties(file);
 
-    return z;
+    return zip.z;
 }
 
 string ASiContainer::mediaType() const
@@ -270,23 +304,87 @@ void ASiContainer::save(const string &path)
     canSave();
     if(!path.empty())
         d->path = path;
+    for(DataFile *file: dataFiles())
+        static_cast<DataFilePrivate*>(file)->detach(d->path);
     ZipSerialize s(d->path, true);
-    s.addFile("mimetype", zproperty("mimetype"), false)(mediaType());
-
-    array<char,10240> buf{};
+    s.addFile("mimetype", zproperty("mimetype"), ZipSerialize::STORED)(mediaType());
+
+    // Deflate chunks on worker threads and write them to archive in order
+    struct Block {
+        const DataFile *file;
+        bool last;
+        int level;
+        future<ZipSerialize::Chunk> chunk;
+    };
+    ThreadPool::Group pool;
+    deque<Block> queue;
+    optional<ZipSerialize::Write> f;
+    auto write = [&] {
+        Block block = std::move(queue.front());
+        queue.pop_front();
+        if(!f)
+            f.emplace(s.addRawFile(block.file->fileName(), zproperty(block.file->fileName()), block.level));
+        (*f)(pool.wait(block.chunk));
+        if(!block.last)
+            return;
+        f->close();
+        f.reset();
+    };
+    const size_t inflight = pool.size() * 2;
+    const int confLevel = clamp(CONF(compressionLevel), ZipSerialize::DEFAULT_LEVEL, 9);
+    const bool probe = CONF(compressionProbe);
+    const set<string> skipExtensions = CONF(compressionSkipExtensions);
+    const set<string> skipMediaTypes = CONF(compressionSkipMediaTypes);
     for(const DataFile *file: dataFiles())
     {
-        auto f = s.addFile(file->fileName(), zproperty(file->fileName()));
         const auto &is = static_cast<const DataFilePrivate*>(file)->m_is;
         is->clear();
         is->seekg(0);
-        while(*is)
+        string prev;
+        int level = confLevel;
+        for(bool first = true, last = false; !last; first = false)
         {
-            is->read(buf.data(), buf.size());
-            if(auto size = is->gcount(); size > 0)
-                f(buf.data(), size_t(size));
+            string data(ZipSerialize::CHUNK_SIZE, 0);
+            is->read(data.data(), streamsize(data.size()));
+            data.resize(size_t(is->gcount()));
+            if(is->bad())
+                THROW("Failed to read '%s' data.", file->fileName().c_str());
+            last = !*is || is->peek() == istream::traits_type::eof();
+            if(first)
+            {
+                // Store already compressed documents, decided by first block of file
+                string name = file->fileName();
+                size_t pos = name.find_last_of("./");
+                if(skipMediaTypes.contains(to_lower(file->mediaType())) ||
+                    (pos != string::npos && name[pos] == '.' && skipExtensions.contains(to_lower(name.substr(pos + 1)))) ||
+                    (probe && !ZipSerialize::compressible(data)))
+                    level = ZipSerialize::STORED;
+                if(level == ZipSerialize::STORED)
+                {
+                    while(!queue.empty())
+                        write();
+                    f.emplace(s.addFile(name, zproperty(name), ZipSerialize::STORED));
+                }
+            }
+            if(level == ZipSerialize::STORED)
+            {
+                (*f)(data);
+                if(last)
+                    f.reset();
+                continue;
+            }
+            size_t dict = min(prev.size(), ZipSerialize::DICT_SIZE);
+            string input = prev.substr(prev.size() - dict) + data;
+            prev = std::move(data);
+            if(queue.size() >= inflight)
+                write();
+            queue.push_back({file, last, level, pool.submit([input = std::move(input), dict, last, level] {
+                return ZipSerialize::deflate(span(input).subspan(dict), span(input).first(dict), last, level);
+            })});
         }
     }
+    while(!queue.empty())
+        write();
 
     save(s);
 }
@@ -28,6 +28,20 @@ namespace digidoc
 {
     struct XMLDocument;
 
+    /**
+     * ZIP archive with its entry list and mimetype, read once when the container format is
+     * detected and reused by the implementation that loads it.
+     */
+    struct ZipProbe
+    {
+        explicit ZipProbe(const std::string &path);
+        static std::unique_ptr<ZipProbe> open(const std::string &path);
+
+        ZipSerialize z;
+        std::vector<std::string> list;
+        std::string mimetype;
+    };
+
     /**
      * Base class for the ASiC (Associated Signature Container) documents.
      * Implements the operations and data structures common for more specific ASiC
@@ -67,7 +81,7 @@ namespace digidoc
           Signature* addSignature(std::unique_ptr<Signature> &&signature);
           virtual void canSave() = 0;
           XMLDocument createManifest() const;
-          ZipSerialize load(bool requireMimetype, const std::set<std::string_view> &supported);
+          const ZipSerialize& load(const ZipProbe &zip, bool requireMimetype, const std::set<std::string_view> &supported);
           virtual void save(const ZipSerialize &s) = 0;
           void deleteSignature(Signature* s);
           static void validateDataFilePath(std::string_view fileName);
@@ -35,14 +35,14 @@ Conf* Conf::INSTANCE = nullptr;
 
 /**
  * @typedef digidoc::ConfCurrent
- * Reference to latest ConfV5 class.
+ * Reference to latest ConfV6 class.
  */
 
 /**
  * @class digidoc::Conf
  * @brief Configuration class which can reimplemented and virtual methods overloaded.
  *
- * @deprecated Since 3.12.2, use digidoc::ConfV5
+ * @deprecated Since 3.12.2, use digidoc::ConfV6
  * @see @ref parameters
  */
 /**
@@ -240,7 +240,7 @@ string Conf::verifyServiceUri() const { return SIVA_URL; }
  * https://techbase.kde.org/Policies/Binary_Compatibility_Issues_With_C++#Adding_new_virtual_functions_to_leaf_classes
  * @since 3.12.2
  * @see digidoc::Conf
- * @deprecated Since 3.13.8, use digidoc::ConfV5
+ * @deprecated Since 3.13.8, use digidoc::ConfV6
  * @see @ref parameters
  */
 /**
@@ -272,7 +272,7 @@ X509Cert ConfV2::verifyServiceCert() const { return X509Cert(); }
  * https://techbase.kde.org/Policies/Binary_Compatibility_Issues_With_C++#Adding_new_virtual_functions_to_leaf_classes
  * @since 3.13.8
  * @see digidoc::ConfV2
- * @deprecated Since 3.14.7, use digidoc::ConfV5
+ * @deprecated Since 3.14.7, use digidoc::ConfV6
  * @see @ref parameters
  */
 /**
@@ -306,7 +306,7 @@ set<string> ConfV3::OCSPTMProfiles() const { return { "1.3.6.1.4.1.10015.4.1.2"
  * https://techbase.kde.org/Policies/Binary_Compatibility_Issues_With_C++#Adding_new_virtual_functions_to_leaf_classes
  * @since 3.14.7
  * @see digidoc::ConfV3
- * @deprecated Since 3.15.0, use digidoc::ConfV5
+ * @deprecated Since 3.15.0, use digidoc::ConfV6
  * @see @ref parameters
  */
 /**
@@ -341,6 +341,7 @@ vector<X509Cert> ConfV4::verifyServiceCerts() const
  * https://techbase.kde.org/Policies/Binary_Compatibility_Issues_With_C++#Adding_new_virtual_functions_to_leaf_classes
  * @since 3.15.0
  * @see digidoc::ConfV4
+ * @deprecated Since 4.5.0, use digidoc::ConfV6
  * @see @ref parameters
  */
 /**
@@ -363,3 +364,122 @@ vector<X509Cert> ConfV5::TSCerts() const
 {
     return {};
 }
+
+/**
+ * @class digidoc::ConfV6
+ * @brief Verison 6 of configuration class to add additonial parameters.
+ *
+ * Conf contains virtual members and is not leaf class we need create
+ * subclasses to keep binary compatibility
+ * https://techbase.kde.org/Policies/Binary_Compatibility_Issues_With_C++#Adding_new_virtual_functions_to_leaf_classes
+ * @since 4.5.0
+ * @see digidoc::ConfV5
+ * @see @ref parameters
+ */
+/**
+ * Version 6 config with new parameters
+ */
+ConfV6::ConfV6() = default;
+
+ConfV6::~ConfV6() = default;
+
+/**
+ * @copydoc digidoc::Conf::instance()
+ */
+ConfV6* ConfV6::instance() { return dynamic_cast<ConfV6*>(Conf::instance()); }
+
+/**
+ * Gets compression level of container documents, -1 for zlib default level, 0 to store documents
+ * without compression and 1-9 from fastest to best compression
+ * @since 4.5.0
+ */
+int ConfV6::compressionLevel() const
+{
+    return -1;
+}
+
+/**
+ * Gets if the first block of container documents is probed and documents containing
+ * high entropy (already compressed or encrypted) data are stored without compression
+ * @since 4.5.0
+ */
+bool ConfV6::compressionProbe() const
+{
+    return true;
+}
+
+/**
+ * Gets file extensions of container documents that are stored without compression
+ * @since 4.5.0
+ */
+set<string> ConfV6::compressionSkipExtensions() const
+{
+    return { "7z", "asice", "asics", "bdoc", "docx", "gif", "gz", "jpeg", "jpg", "mp3", "mp4",
+        "odp", "ods", "odt", "pdf", "png", "pptx", "sce", "scs", "xlsx", "zip" };
+}
+
+/**
+ * Gets media types of container documents that are stored without compression
+ * @since 4.5.0
+ */
+set<string> ConfV6::compressionSkipMediaTypes() const
+{
+    return { "application/gzip", "application/pdf", "application/vnd.etsi.asic-e+zip",
+        "application/vnd.etsi.asic-s+zip", "application/x-7z-compressed", "application/zip",
+        "audio/mpeg", "image/gif", "image/jpeg", "image/png", "video/mp4" };
+}
+
+/**
+ * Gets interval in seconds of background TSL refresh, 0 disables background refresh
+ * @since 4.5.0
+ */
+int ConfV6::TSLRefreshInterval() const
+{
+    return 0;
+}
+
+/**
+ * Gets number of worker threads used for parallel TSL loading and document compression,
+ * 0 to use number of hardware threads. Value is read once on first use.
+ * @since 4.5.0
+ */
+int ConfV6::threadPoolSize() const
+{
+    return 0;
+}
+
+/**
+ * Gets if OCSP responses are cached and reused while they are valid
+ * @since 4.5.0
+ */
+bool ConfV6::OCSPCache() const
+{
+    return false;
+}
+
+/**
+ * Gets directory where cached OCSP responses are also stored, empty to keep them only in memory
+ * @since 4.5.0
+ */
+string ConfV6::OCSPCachePath() const
+{
+    return {};
+}
+
+/**
+ * Gets number of idle HTTP keep-alive connections kept per host, 0 closes connection after each request
+ * @since 4.5.0
+ */
+int ConfV6::connectionPoolSize() const
+{
+    return 0;
+}
+
+/**
+ * Gets time in seconds after idle HTTP keep-alive connection is not reused
+ * @since 4.5.0
+ */
+int ConfV6::connectionIdleTimeout() const
+{
+    return 30;
+}
@@ -126,6 +126,32 @@ private:
     DISABLE_COPY(ConfV5);
 };
 
-using ConfCurrent = ConfV5;
+class DIGIDOCPP_EXPORT ConfV6: public ConfV5
+{
+public:
+    ConfV6();
+    ~ConfV6() override;
+    static ConfV6* instance();
+
+    virtual int compressionLevel() const;
+    virtual bool compressionProbe() const;
+    virtual std::set<std::string> compressionSkipExtensions() const;
+    virtual std::set<std::string> compressionSkipMediaTypes() const;
+
+    virtual int TSLRefreshInterval() const;
+
+    virtual int threadPoolSize() const;
+
+    virtual bool OCSPCache() const;
+    virtual std::string OCSPCachePath() const;
+
+    virtual int connectionPoolSize() const;
+    virtual int connectionIdleTimeout() const;
+
+private:
+    DISABLE_COPY(ConfV6);
+};
+
+using ConfCurrent = ConfV6;
 #define CONF(method) (ConfCurrent::instance() ? ConfCurrent::instance()->method() : ConfCurrent().method())
 }
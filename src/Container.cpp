@@ -23,13 +23,16 @@
 #include "ASiC_S.h"
 #include "Exception.h"
 #include "PDF.h"
+#include "SignatureXAdES_B.h"
 #include "SiVaContainer.h"
 #include "XmlConf.h"
+#include "XMLDocument.h"
 #include "crypto/Signer.h"
 #include "crypto/X509CertStore.h"
 #include "util/algorithm.h"
 #include "util/File.h"
 #include "util/log.h"
+#include "util/ThreadPool.h"
 
 #include <libxml/parser.h>
 #ifndef XMLSEC_NO_XSLT
@@ -39,6 +42,7 @@
 #include <xmlsec/crypto.h>
 
 #include <functional>
+#include <future>
 #include <sstream>
 #include <thread>
 
@@ -52,6 +56,29 @@ static string m_userAgent = "libdigidocpp";
 static vector<decltype(&Container::createPtr)> m_createList {};
 static vector<std::unique_ptr<Container> (*)(const std::string &path, ContainerOpenCB *cb)> m_openList {};
 int initXmlSecCallback();
+
+/**
+ * Returns signature indexes grouped by signature document, signatures in same document share
+ * XML tree and must not be processed concurrently.
+ */
+static vector<vector<size_t>> groupByDocument(const vector<Signature*> &signatures)
+{
+    vector<pair<const void*,vector<size_t>>> groups;
+    for(size_t i = 0; i < signatures.size(); ++i)
+    {
+        const void *doc = signatures[i];
+        if(auto *xades = dynamic_cast<SignatureXAdES_B*>(signatures[i]))
+            doc = xades->signatures.get();
+        auto group = find_if(groups.begin(), groups.end(), [doc](const auto &g) { return g.first == doc; });
+        if(group == groups.end())
+            group = groups.insert(groups.end(), {doc, {}});
+        group->second.push_back(i);
+    }
+    vector<vector<size_t>> result;
+    for(auto &[doc, group]: groups)
+        result.push_back(std::move(group));
+    return result;
+}
 }
 
 /**
@@ -100,7 +127,8 @@ void digidoc::initialize(const string &appInfo, initCallBack callBack)
  * @since 3.14.3
  * @param appInfo Application name for container comments
  * @param userAgent Application info for user agent string
- * @param callBack Callback when background thread TSL loading is completed
+ * @param callBack Callback when background thread TSL loading is completed, with background
+ * TSL refresh (see \ref conf) also called after each refresh
  */
 void digidoc::initialize(const string &appInfo, const string &userAgent, initCallBack callBack)
 {
@@ -137,7 +165,13 @@ void digidoc::initialize(const string &appInfo, const string &userAgent, initCal
     Container::addContainerImplementation<SiVaContainer>();
     Container::addContainerImplementation<ASiC_S>();
 
-    if(callBack)
+    if(int interval = CONF(TSLRefreshInterval); interval > 0)
+    {
+        if(!callBack)
+            X509CertStore::instance()->update();
+        X509CertStore::instance()->startRefresh(chrono::seconds(interval), callBack, callBack != nullptr);
+    }
+    else if(callBack)
     {
         thread([callBack]{
             try {
@@ -161,12 +195,14 @@ void digidoc::initialize(const string &appInfo, const string &userAgent, initCal
  */
 void digidoc::terminate()
 {
+    X509CertStore::instance()->stopRefresh();
     try {
         Conf::init(nullptr);
     } catch (...) {
         // Don't throw on terminate
     }
 
+    XMLSchema::clearCache();
     xmlSecCryptoShutdown();
     xmlSecCryptoAppShutdown();
     xmlSecShutdown();
@@ -321,6 +357,101 @@ unique_ptr<Container> Container::createPtr(const std::string &path)
     return ASiC_E::createInternal(path);
 }
 
+/**
+ * Extends profile of multiple signatures, e.g. signatures prepared in a batch of containers.
+ *
+ * Time-stamp and OCSP requests of different signatures are made concurrently on library worker
+ * threads (see \ref threadpool-settings), enable HTTP keep-alive (see \ref connection-settings)
+ * to reuse connections between requests. Signatures stored in same signature document are
+ * extended sequentially. Containers of signatures must not be used until the call returns.
+ *
+ * @since 4.5.0
+ * @param signatures signatures to extend.
+ * @param signer signer implementation, provides target profile and user agent.
+ * @throws Exception with failed signatures as causes, other signatures are extended.
+ * @see digidoc::Signature::extendSignatureProfile
+ */
+void Container::extendSignatureProfiles(const vector<Signature*> &signatures, Signer *signer)
+{
+    if(!signer)
+        THROW("Invalid signer");
+    util::ThreadPool::Group pool;
+    vector<future<vector<Exception>>> tasks;
+    for(const auto &group: groupByDocument(signatures))
+    {
+        tasks.push_back(pool.submit([&signatures, group, signer] {
+            vector<Exception> errors;
+            for(size_t i: group)
+            {
+                Signature *s = signatures[i];
+                try {
+                    s->extendSignatureProfile(signer);
+                } catch(const Exception &e) {
+                    Exception ex(EXCEPTION_PARAMS("Failed to extend signature '%s'", s->id().c_str()));
+                    ex.addCause(e);
+                    errors.push_back(std::move(ex));
+                }
+            }
+            return errors;
+        }));
+    }
+    Exception e(EXCEPTION_PARAMS("Failed to extend signatures"));
+    exception_ptr error;
+    for(auto &task: tasks)
+    {
+        try {
+            for(const Exception &ex: pool.wait(task))
+                e.addCause(ex);
+        } catch(...) {
+            if(!error)
+                error = current_exception();
+        }
+    }
+    if(error)
+        rethrow_exception(error);
+    if(!e.causes().empty())
+        throw e;
+}
+
+/**
+ * Validates all signatures of the container.
+ *
+ * Signatures are validated concurrently on library worker threads (see \ref threadpool-settings),
+ * signatures stored in same signature document are validated sequentially. Cached data file
+ * digests are shared between signatures. Container must not be modified until the call returns.
+ *
+ * @since 4.5.0
+ * @return validation results in the order of signatures().
+ * @see digidoc::Signature::Validator
+ */
+vector<unique_ptr<Signature::Validator>> Container::validateAll() const
+{
+    vector<Signature*> list = signatures();
+    vector<unique_ptr<Signature::Validator>> result(list.size());
+    util::ThreadPool::Group pool;
+    vector<future<void>> tasks;
+    for(const auto &group: groupByDocument(list))
+    {
+        tasks.push_back(pool.submit([&list, &result, group] {
+            for(size_t i: group)
+                result[i] = make_unique<Signature::Validator>(list[i]);
+        }));
+    }
+    exception_ptr error;
+    for(auto &task: tasks)
+    {
+        try {
+            pool.wait(task);
+        } catch(...) {
+            if(!error)
+                error = current_exception();
+        }
+    }
+    if(error)
+        rethrow_exception(error);
+    return result;
+}
+
 /**
  * Extends the validity of signatures in the container by adding a new timestamp.
  *
@@ -498,6 +629,10 @@ Container* Container::open(const string &path)
 /**
  * Opens container from a file
  *
+ * ZIP based containers are memory mapped and data files are read from the mapping while the
+ * container is open. Replacing or deleting the file does not affect opened container, but the
+ * file must not be modified in place until the container is released.
+ *
  * @since 3.14.4
  * @param path
  * @throws Exception
@@ -517,11 +652,23 @@ unique_ptr<Container> Container::openPtr(const string &path)
  */
 unique_ptr<Container> Container::openPtr(const string &path, ContainerOpenCB *cb)
 {
-    for(auto open: m_openList)
+    // Read ZIP archive entries and mimetype once, built-in ASiC implementations decide on it
+    unique_ptr<ZipProbe> zip = ZipProbe::open(path);
+    using Open = decltype(m_openList)::value_type;
+    for(Open open: m_openList)
     {
-        if(unique_ptr<Container> container = open(path, cb))
+        unique_ptr<Container> container;
+        if(zip && open == static_cast<Open>(&SiVaContainer::openInternal))
+            container = SiVaContainer::openInternal(*zip, cb);
+        else if(open == static_cast<Open>(&ASiC_S::openInternal))
+            container = zip ? ASiC_S::openInternal(*zip) : nullptr;
+        else
+            container = open(path, cb);
+        if(container)
             return container;
     }
+    if(zip)
+        return ASiC_E::openInternal(*zip);
     return ASiC_E::openInternal(path);
 }
 
@@ -19,7 +19,7 @@
 
 #pragma once
 
-#include "Exports.h"
+#include "Signature.h"
 
 #include <memory>
 #include <string>
@@ -67,6 +67,8 @@ public:
 
     virtual void addDataFile(std::unique_ptr<std::istream> is, const std::string &fileName, const std::string &mediaType);
 
+    std::vector<std::unique_ptr<Signature::Validator>> validateAll() const;
+
     DIGIDOCPP_DEPRECATED static Container* create(const std::string &path);
     static std::unique_ptr<Container> createPtr(const std::string &path);
     DIGIDOCPP_DEPRECATED static Container* open(const std::string &path);
@@ -76,6 +78,7 @@ public:
     static void addContainerImplementation();
 
     static std::unique_ptr<Container> extendContainerValidity(Container &doc, Signer *signer, size_t &extendedCount);
+    static void extendSignatureProfiles(const std::vector<Signature*> &signatures, Signer *signer);
 
 protected:
     virtual std::string path() const;
@@ -19,6 +19,7 @@
 
 #include "DataFile_p.h"
 
+#include "Metrics_p.h"
 #include "crypto/Digest.h"
 #include "util/File.h"
 #include "util/log.h"
@@ -27,6 +28,10 @@
 #include <array>
 #include <filesystem>
 #include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <spanstream>
 #include <sstream>
 
 using namespace digidoc;
@@ -88,6 +93,42 @@ DataFile::~DataFile() = default;
 
 struct DataFilePrivate::Private {
     optional<unsigned long> size;
+    ZipSerialize::View view;
+    string source;
+    set<string> methods;
+    ContentDigests digests;
+    optional<MultiDigest> pending;
+    // Content is read by calcDigest or reference verification, which hash it themselves
+    bool direct = false;
+    // Guards content stream position and digest cache between validation threads
+    mutex m;
+
+    vector<string> missing() const
+    {
+        vector<string> result;
+        for(const string &method: methods)
+        {
+            if(!digests.contains(method))
+                result.push_back(method);
+        }
+        return result;
+    }
+
+    void sink(uint64_t offset, span<const char> data)
+    {
+        if(offset == 0)
+        {
+            pending.reset();
+            if(!direct)
+                pending.emplace(missing());
+        }
+        if(!pending)
+            return;
+        if(!data.empty())
+            return pending->update((const unsigned char*)data.data(), data.size());
+        digests.current().merge(pending->result());
+        pending.reset();
+    }
 };
 
 DataFilePrivate::DataFilePrivate(unique_ptr<istream> &&is, string filename, string mediatype, string id)
@@ -103,7 +144,24 @@ DataFilePrivate::DataFilePrivate(const ZipSerialize &z, string filename, string
     , m_filename(std::move(filename))
     , m_mediatype(std::move(mediatype))
 {
-    auto r = z.read(m_filename);
+    if(d->view = z.stored(m_filename); d->view)
+    {
+        d->size.emplace((unsigned long)d->view->size());
+        m_is = make_unique<ispanstream>(span<const char>((const char*)d->view->data(), d->view->size()));
+    }
+    else if(m_is = z.stream(m_filename, [d = d.get()](uint64_t offset, span<const char> data) {
+            d->sink(offset, data);
+        }); !m_is)
+    {
+        // ZIP file could not be mapped, content would have to be read by name later
+        extract(z.read(m_filename));
+        return;
+    }
+    d->source = z.path();
+}
+
+void DataFilePrivate::extract(ZipSerialize::Read &&r)
+{
     d->size.emplace((unsigned long)r.size);
     if(r.size > MAX_MEM_FILE)
     {
@@ -126,18 +184,73 @@ DataFilePrivate::DataFilePrivate(const ZipSerialize &z, string filename, string
             fs->clear();
             if(!fs->seekg(0, istream::beg))
                 THROW("Failed to rewind '%s' temporary file.", m_filename.c_str());
-            m_is = std::move(fs);
+            replace(std::move(fs));
         } catch(...) {
             if(!m_tempFile.empty())
             {
                 error_code ec;
                 filesystem::remove(m_tempFile, ec);
+                m_tempFile.clear();
             }
             throw;
         }
     }
     else
-        m_is = make_unique<stringstream>(r(MAX_MEM_FILE));
+        replace(make_unique<stringstream>(r(MAX_MEM_FILE)));
+}
+
+/**
+ * Replaces content stream and advances content generation, so digests of the previous stream are
+ * not reused for the new content.
+ *
+ * @param is new content stream.
+ * @param unchanged new stream has the same content and calculated digests remain valid.
+ */
+void DataFilePrivate::replace(unique_ptr<istream> &&is, bool unchanged)
+{
+    m_is = std::move(is);
+    d->digests.replaced(unchanged);
+}
+
+/**
+ * Copies mapped or not yet extracted content to private storage when the source ZIP file is
+ * going to be overwritten in place.
+ *
+ * @param path destination path where the container is about to be saved.
+ */
+void DataFilePrivate::detach(const string &path)
+{
+    error_code ec;
+    if(d->source.empty() || !filesystem::equivalent(File::encodeName(path), File::encodeName(d->source), ec))
+        return;
+    if(!d->view)
+    {
+        // Decompress from the mapping held by the stream, the file may have been replaced
+        unique_ptr<iostream> copy;
+        if(fileSize() > MAX_MEM_FILE)
+        {
+            m_tempFile = util::File::tempFileName();
+            copy = make_unique<fstream>(m_tempFile, fstream::in|fstream::out|fstream::binary|fstream::trunc);
+        }
+        else
+            copy = make_unique<stringstream>();
+        saveAs(*copy);
+        if(!copy->flush() || !copy->seekg(0))
+            THROW("Failed to write '%s' data to temporary file.", m_filename.c_str());
+        replace(std::move(copy), true);
+    }
+    else if(d->view->size() > MAX_MEM_FILE)
+    {
+        m_tempFile = util::File::tempFileName();
+        auto fs = make_unique<fstream>(m_tempFile, fstream::in|fstream::out|fstream::binary|fstream::trunc);
+        if(!fs->is_open() || !fs->write((const char*)d->view->data(), streamsize(d->view->size())) || !fs->flush() || !fs->seekg(0))
+            THROW("Failed to write '%s' data to temporary file.", m_filename.c_str());
+        replace(std::move(fs), true);
+    }
+    else
+        replace(make_unique<stringstream>(string((const char*)d->view->data(), d->view->size())), true);
+    d->view.reset();
+    d->source.clear();
 }
 
 DataFilePrivate::~DataFilePrivate() noexcept
@@ -150,22 +263,92 @@ DataFilePrivate::~DataFilePrivate() noexcept
     }
 }
 
+template<class T>
+static void update(const T &digest, const DataFilePrivate &file, const ZipSerialize::View &view)
+{
+    if(view)
+        return digest.update((const unsigned char*)view->data(), view->size());
+    file.m_is->clear();
+    file.m_is->seekg(0);
+    digest.update(*file.m_is);
+    if(file.m_is->bad())
+        THROW("Failed to read '%s' data.", file.m_filename.c_str());
+}
+
 void DataFilePrivate::digest(const Digest &digest) const
 {
+    lock_guard lock(d->m);
+    update(digest, *this, d->view);
+}
+
+/**
+ * Returns content reader positioned to the beginning. Mapped content gets independent reader,
+ * otherwise the shared stream is locked until the reader is released. Reader is used for
+ * reference verification that hashes content itself, registered digests are not calculated.
+ */
+unique_ptr<DataFilePrivate::Input> DataFilePrivate::input() const
+{
+    auto input = make_unique<Input>();
+    if(d->view)
+    {
+        input->view = make_unique<ispanstream>(span<const char>((const char*)d->view->data(), d->view->size()));
+        input->is = input->view.get();
+        return input;
+    }
+    input->lock = unique_lock(d->m);
+    d->direct = true;
+    input->direct = &d->direct;
     m_is->clear();
     m_is->seekg(0);
-    digest.update(*m_is);
+    input->is = m_is.get();
+    return input;
+}
+
+/**
+ * Registers digest method that is calculated alongside decompression, when the entry is read
+ * from the beginning to the end with saveAs(), or together with the method requested from calcDigest().
+ *
+ * @param method digest method URI, unsupported methods are ignored.
+ */
+void DataFilePrivate::addDigestMethod(const string &method)
+{
+    if(d->methods.contains(method))
+        return;
+    try {
+        Digest calc(method);
+        d->methods.insert(method);
+    } catch(const Exception &) {
+        DEBUG("Ignoring unsupported digest method '%s'", method.c_str());
+    }
 }
 
 vector<unsigned char> DataFilePrivate::calcDigest(const string &method) const
 {
-    Digest d(method);
-    digest(d);
-    return d.result();
+    lock_guard lock(d->m);
+    auto &digests = d->digests.current();
+    bool cached = digests.contains(method);
+    MetricsPrivate::cache(MetricsPrivate::DataFileDigestCache, cached);
+    if(cached)
+        return digests[method];
+    // Calculate requested and pending methods in one read, decompression sink is not needed
+    vector<string> methods = d->missing();
+    methods.push_back(method);
+    MultiDigest calc(methods);
+    d->direct = true;
+    try {
+        update(calc, *this, d->view);
+    } catch(...) {
+        d->direct = false;
+        throw;
+    }
+    d->direct = false;
+    digests.merge(calc.result());
+    return digests[method];
 }
 
 unsigned long DataFilePrivate::fileSize() const
 {
+    lock_guard lock(d->m);
     if(d->size.has_value())
         return d->size.value();
     m_is->clear();
@@ -183,7 +366,16 @@ void DataFilePrivate::saveAs(const string& path) const
 
 void DataFilePrivate::saveAs(ostream &os) const
 {
+    lock_guard lock(d->m);
     m_is->clear();
     m_is->seekg(0);
-    os << m_is->rdbuf();
+    array<char,10240> buf{};
+    while(*m_is)
+    {
+        m_is->read(buf.data(), buf.size());
+        if(auto size = m_is->gcount(); size > 0)
+            os.write(buf.data(), size);
+    }
+    if(m_is->bad())
+        THROW("Failed to read '%s' data.", m_filename.c_str());
 }
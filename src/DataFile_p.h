@@ -20,10 +20,13 @@
 #pragma once
 
 #include "DataFile.h"
+#include "util/ZipSerialize.h"
 
 #include <filesystem>
 #include <istream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 
 namespace digidoc
@@ -32,7 +35,42 @@ namespace digidoc
 constexpr unsigned long MAX_MEM_FILE = 500UL*1024UL*1024UL;
 
 class Digest;
-class ZipSerialize;
+
+/**
+ * Digests of data file content by method URI. Digests belong to the content generation they were
+ * calculated for, the generation is advanced whenever the content stream is replaced.
+ */
+class ContentDigests: public std::map<std::string,std::vector<unsigned char>>
+{
+public:
+    /**
+     * Returns digests of current content, digests of replaced content are discarded.
+     */
+    ContentDigests& current()
+    {
+        if(calculated != generation)
+        {
+            clear();
+            calculated = generation;
+        }
+        return *this;
+    }
+
+    /**
+     * Advances content generation after the content stream was replaced.
+     *
+     * @param unchanged new stream has the same content and calculated digests remain valid.
+     */
+    void replaced(bool unchanged = false)
+    {
+        ++generation;
+        if(unchanged)
+            calculated = generation;
+    }
+
+private:
+    uint64_t generation = 0, calculated = 0;
+};
 
 class DataFilePrivate final: public DataFile
 {
@@ -46,6 +84,18 @@ public:
     unsigned long fileSize() const final;
     std::string mediaType() const final { return m_mediatype; }
 
+    struct Input
+    {
+        std::unique_lock<std::mutex> lock;
+        std::unique_ptr<std::istream> view;
+        std::istream *is {};
+        bool *direct {};
+        ~Input() noexcept { if(direct) *direct = false; }
+    };
+
+    void addDigestMethod(const std::string &method);
+    std::unique_ptr<Input> input() const;
+    void detach(const std::string &path);
     void digest(const Digest &method) const;
     std::vector<unsigned char> calcDigest(const std::string &method) const final;
     void saveAs(std::ostream &os) const final;
@@ -56,5 +106,9 @@ public:
     std::filesystem::path m_tempFile;
     std::unique_ptr<std::istream> m_is;
     std::string m_id, m_filename, m_mediatype;
+
+private:
+    void extract(ZipSerialize::Read &&r);
+    void replace(std::unique_ptr<std::istream> &&is, bool unchanged = false);
 };
 }
@@ -0,0 +1,174 @@
+/*
+ * libdigidocpp
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "Metrics_p.h"
+
+#include <mutex>
+
+using namespace digidoc;
+using namespace std;
+
+namespace {
+mutex m;
+map<string,Metrics::Host,less<>> requests;
+}
+
+atomic<bool> MetricsPrivate::active {false};
+array<atomic<uint64_t>,MetricsPrivate::CounterCount> MetricsPrivate::counters {};
+array<atomic<uint64_t>,MetricsPrivate::CacheCount> MetricsPrivate::hits {};
+array<atomic<uint64_t>,MetricsPrivate::CacheCount> MetricsPrivate::misses {};
+
+/**
+ * Records completed HTTP request.
+ *
+ * @param host target host name.
+ * @param begin time request was started, request is not recorded when empty.
+ * @param failed request threw, response status was not 2xx or response was not received completely.
+ */
+void MetricsPrivate::request(string_view host, chrono::steady_clock::time_point begin, bool failed)
+{
+    if(!enabled() || begin == chrono::steady_clock::time_point{})
+        return;
+    auto elapsed = chrono::steady_clock::now() - begin;
+    lock_guard lock(m);
+    auto i = requests.find(host);
+    if(i == requests.end())
+        i = requests.emplace(host, Metrics::Host{}).first;
+    ++i->second.requests;
+    if(failed)
+        ++i->second.failures;
+    i->second.latency += chrono::duration_cast<chrono::nanoseconds>(elapsed);
+}
+
+/**
+ * @struct digidoc::Metrics
+ * @brief Process-wide counters of library I/O, crypto and network stages.
+ * @since 4.5.0
+ *
+ * Counters are collected only when enabled with setEnabled() and can be polled with snapshot(),
+ * eg. to export them to a monitoring system. Times are cumulative and counters only grow until reset().
+ *
+ * @var digidoc::Metrics::zipInflatedBytes
+ * Bytes decompressed while reading ZIP entries.
+ * @var digidoc::Metrics::zipDeflatedBytes
+ * Bytes compressed while writing ZIP entries.
+ * @var digidoc::Metrics::digestBytes
+ * Bytes hashed, data hashed with several algorithms is counted for each of them. Includes data file
+ * content hashed by XML signature reference verification.
+ * @var digidoc::Metrics::digestTime
+ * Time spent on hashing.
+ * @var digidoc::Metrics::c14nCount
+ * Number of XML canonicalizations calculated by library.
+ * @var digidoc::Metrics::c14nTime
+ * Time spent on XML canonicalization, including hashing of the output.
+ * @var digidoc::Metrics::verifyCount
+ * Number of XML signature verifications.
+ * @var digidoc::Metrics::verifyTime
+ * Time spent on XML signature verification, including reference digests.
+ * @var digidoc::Metrics::ocspRequests
+ * Number of OCSP requests sent.
+ * @var digidoc::Metrics::tsaRequests
+ * Number of time-stamp requests sent.
+ * @var digidoc::Metrics::tslDownloads
+ * Number of TSL downloads.
+ * @var digidoc::Metrics::hosts
+ * HTTP requests by host with number of failed requests and cumulative latency
+ * from sending request to receiving complete response.
+ * @var digidoc::Metrics::caches
+ * Hits and misses by cache: schema, trustStore, issuerSignature, ocspResponse, dataFileDigest.
+ *
+ * @struct digidoc::Metrics::Host
+ * @brief HTTP request counters of host.
+ * @var digidoc::Metrics::Host::requests
+ * Number of requests.
+ * @var digidoc::Metrics::Host::failures
+ * Number of requests that failed, returned non-2xx status or did not receive complete response.
+ * @var digidoc::Metrics::Host::latency
+ * Cumulative request latency.
+ *
+ * @struct digidoc::Metrics::Cache
+ * @brief Cache lookup counters.
+ * @var digidoc::Metrics::Cache::hits
+ * Number of lookups that reused cached data.
+ * @var digidoc::Metrics::Cache::misses
+ * Number of lookups that had to compute or fetch data.
+ */
+
+/**
+ * Enables or disables collecting of metrics, disabled by default.
+ */
+void Metrics::setEnabled(bool enabled)
+{
+    MetricsPrivate::active.store(enabled, memory_order_relaxed);
+}
+
+/**
+ * Returns if metrics are collected.
+ */
+bool Metrics::isEnabled()
+{
+    return MetricsPrivate::enabled();
+}
+
+/**
+ * Returns current values of counters.
+ */
+Metrics Metrics::snapshot()
+{
+    auto get = [](MetricsPrivate::Counter counter) {
+        return MetricsPrivate::counters[counter].load(memory_order_relaxed);
+    };
+    Metrics result;
+    result.zipInflatedBytes = get(MetricsPrivate::ZipInflatedBytes);
+    result.zipDeflatedBytes = get(MetricsPrivate::ZipDeflatedBytes);
+    result.digestBytes = get(MetricsPrivate::DigestBytes);
+    result.digestTime = chrono::nanoseconds(get(MetricsPrivate::DigestTime));
+    result.c14nCount = get(MetricsPrivate::C14NCount);
+    result.c14nTime = chrono::nanoseconds(get(MetricsPrivate::C14NTime));
+    result.verifyCount = get(MetricsPrivate::VerifyCount);
+    result.verifyTime = chrono::nanoseconds(get(MetricsPrivate::VerifyTime));
+    result.ocspRequests = get(MetricsPrivate::OCSPRequests);
+    result.tsaRequests = get(MetricsPrivate::TSARequests);
+    result.tslDownloads = get(MetricsPrivate::TSLDownloads);
+    for(size_t i = 0; i < MetricsPrivate::CacheCount; ++i)
+    {
+        result.caches[MetricsPrivate::CACHES[i]] = {
+            MetricsPrivate::hits[i].load(memory_order_relaxed),
+            MetricsPrivate::misses[i].load(memory_order_relaxed),
+        };
+    }
+    lock_guard lock(m);
+    result.hosts.insert(requests.cbegin(), requests.cend());
+    return result;
+}
+
+/**
+ * Resets all counters to zero.
+ */
+void Metrics::reset()
+{
+    for(auto &counter: MetricsPrivate::counters)
+        counter.store(0, memory_order_relaxed);
+    for(auto &counter: MetricsPrivate::hits)
+        counter.store(0, memory_order_relaxed);
+    for(auto &counter: MetricsPrivate::misses)
+        counter.store(0, memory_order_relaxed);
+    lock_guard lock(m);
+    requests.clear();
+}
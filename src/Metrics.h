@@ -0,0 +1,65 @@
+/*
+ * libdigidocpp
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+
+#include "Exports.h"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace digidoc
+{
+    struct DIGIDOCPP_EXPORT Metrics
+    {
+        struct Host
+        {
+            uint64_t requests = 0;
+            uint64_t failures = 0;
+            std::chrono::nanoseconds latency {};
+        };
+
+        struct Cache
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+        };
+
+        uint64_t zipInflatedBytes = 0;
+        uint64_t zipDeflatedBytes = 0;
+        uint64_t digestBytes = 0;
+        std::chrono::nanoseconds digestTime {};
+        uint64_t c14nCount = 0;
+        std::chrono::nanoseconds c14nTime {};
+        uint64_t verifyCount = 0;
+        std::chrono::nanoseconds verifyTime {};
+        uint64_t ocspRequests = 0;
+        uint64_t tsaRequests = 0;
+        uint64_t tslDownloads = 0;
+        std::map<std::string,Host> hosts;
+        std::map<std::string,Cache> caches;
+
+        static void setEnabled(bool enabled);
+        static bool isEnabled();
+        static Metrics snapshot();
+        static void reset();
+    };
+}
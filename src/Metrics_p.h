@@ -0,0 +1,151 @@
+/*
+ * libdigidocpp
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+
+#include "Metrics.h"
+
+#include <array>
+#include <atomic>
+#include <string_view>
+
+namespace digidoc
+{
+
+/**
+ * Counters updated by library stages. Exported so that the statically linked parts of the library
+ * update the same counters as the shared library. Updates cost one relaxed load when disabled.
+ */
+class DIGIDOCPP_EXPORT MetricsPrivate
+{
+public:
+    enum Counter : uint8_t {
+        ZipInflatedBytes,
+        ZipDeflatedBytes,
+        DigestBytes,
+        DigestTime,
+        C14NCount,
+        C14NTime,
+        VerifyCount,
+        VerifyTime,
+        OCSPRequests,
+        TSARequests,
+        TSLDownloads,
+        CounterCount
+    };
+
+    enum Cache : uint8_t {
+        SchemaCache,
+        TrustStoreCache,
+        IssuerSignatureCache,
+        OCSPResponseCache,
+        DataFileDigestCache,
+        CacheCount
+    };
+
+    static constexpr std::array<const char*,CacheCount> CACHES {
+        "schema", "trustStore", "issuerSignature", "ocspResponse", "dataFileDigest"
+    };
+
+    class Timer
+    {
+    public:
+        explicit Timer(Counter counter) noexcept
+            : counter(counter)
+            , begin(now())
+        {}
+
+        ~Timer() noexcept
+        {
+            if(begin != std::chrono::steady_clock::time_point{})
+                add(counter, uint64_t((std::chrono::steady_clock::now() - begin).count()));
+        }
+
+    private:
+        DISABLE_COPY(Timer);
+        Counter counter;
+        std::chrono::steady_clock::time_point begin;
+    };
+
+    /**
+     * Records HTTP request when destroyed, request is failed unless it is marked succeeded.
+     */
+    class Request
+    {
+    public:
+        explicit Request(std::string_view host) noexcept
+            : host(host)
+            , begin(now())
+        {}
+
+        ~Request() noexcept
+        {
+            try {
+                request(host, begin, failed);
+            } catch(...) {}
+        }
+
+        void succeeded() noexcept
+        {
+            failed = false;
+        }
+
+    private:
+        DISABLE_COPY(Request);
+        std::string_view host;
+        std::chrono::steady_clock::time_point begin;
+        bool failed = true;
+    };
+
+    static bool enabled() noexcept
+    {
+        return active.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns current time when metrics are enabled, empty time point otherwise.
+     */
+    static std::chrono::steady_clock::time_point now() noexcept
+    {
+        return enabled() ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+    }
+
+    static void add(Counter counter, uint64_t value) noexcept
+    {
+        if(enabled())
+            counters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static void cache(Cache cache, bool hit) noexcept
+    {
+        if(enabled())
+            (hit ? hits : misses)[cache].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void request(std::string_view host, std::chrono::steady_clock::time_point begin, bool failed);
+
+private:
+    friend struct Metrics;
+
+    static std::atomic<bool> active;
+    static std::array<std::atomic<uint64_t>,CounterCount> counters;
+    static std::array<std::atomic<uint64_t>,CacheCount> hits, misses;
+};
+
+}
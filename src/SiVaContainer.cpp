@@ -102,7 +102,7 @@ void SignatureSiVa::validate(const string &policy) const
 }
 
 
-SiVaContainer::SiVaContainer(const string &path, ContainerOpenCB *cb, bool useHashCode)
+SiVaContainer::SiVaContainer(const string &path, ContainerOpenCB *cb, bool useHashCode, const ZipProbe *zip)
     : d(make_unique<Private>())
 {
     DEBUG("SiVaContainer::SiVaContainer(%s, %d)", path.c_str(), useHashCode);
@@ -120,25 +120,16 @@ SiVaContainer::SiVaContainer(const string &path, ContainerOpenCB *cb, bool useHa
         d->mediaType = "application/pdf";
         d->dataFiles.push_back(new DataFilePrivate(std::move(ifs), fileName, "application/pdf"));
     }
-    else if(File::fileExtension(path, {"asice", "sce", "asics", "scs"}))
+    else if(zip)
     {
-        ZipSerialize z(path, false);
-        if(d->mediaType = z.mimetype();
-            d->mediaType != ASiContainer::MIMETYPE_ASIC_E && d->mediaType != ASiContainer::MIMETYPE_ASIC_S)
-            THROW("Unknown file");
-        vector<string> list = z.list();
-        if(none_of(list.cbegin(), list.cend(), [](const string &file) {
-                return file.starts_with("META-INF/") && util::File::fileExtension(file, {"p7s"});
-            }))
-            THROW("Unknown file");
-
-        for(const string &file: list)
+        d->mediaType = zip->mimetype;
+        for(const string &file: zip->list)
         {
             if(file == "mimetype" || file.starts_with("META-INF/"))
                 continue;
             if(const auto directory = File::directory(file);
                 directory.empty() || directory == "/" || directory == "./")
-                d->dataFiles.push_back(new DataFilePrivate(z, file, "application/octet-stream"));
+                d->dataFiles.push_back(new DataFilePrivate(zip->z, file, "application/octet-stream"));
         }
     }
     else
@@ -295,12 +286,37 @@ vector<DataFile *> SiVaContainer::dataFiles() const
 }
 
 unique_ptr<Container> SiVaContainer::openInternal(const string &path, ContainerOpenCB *cb)
+{
+    if(File::fileExtension(path, {"asice", "sce", "asics", "scs"}))
+        return openInternal(ZipProbe(path), cb);
+    return open(path, cb, nullptr);
+}
+
+/**
+ * Accepts ASiC archives with CAdES signatures, decision is made on already read mimetype and
+ * entry list.
+ */
+unique_ptr<Container> SiVaContainer::openInternal(const ZipProbe &zip, ContainerOpenCB *cb)
+{
+    const string &path = zip.z.path();
+    if(!File::fileExtension(path, {"asice", "sce", "asics", "scs"}))
+        return open(path, cb, nullptr);
+    if(zip.mimetype != ASiContainer::MIMETYPE_ASIC_E && zip.mimetype != ASiContainer::MIMETYPE_ASIC_S)
+        return {};
+    if(none_of(zip.list.cbegin(), zip.list.cend(), [](const string &file) {
+            return file.starts_with("META-INF/") && util::File::fileExtension(file, {"p7s"});
+        }))
+        return {};
+    return open(path, cb, &zip);
+}
+
+unique_ptr<Container> SiVaContainer::open(const string &path, ContainerOpenCB *cb, const ZipProbe *zip)
 {
     try {
-        return unique_ptr<Container>(new SiVaContainer(path, cb, true));
+        return unique_ptr<Container>(new SiVaContainer(path, cb, true, zip));
     } catch(const Exception &e) {
         if(e.msg().find("Bad digest for DataFile") != string::npos)
-            return unique_ptr<Container>(new SiVaContainer(path, cb, false));
+            return unique_ptr<Container>(new SiVaContainer(path, cb, false, zip));
         if(e.msg() == "Unknown file")
             return {};
         throw;
@@ -27,6 +27,7 @@ namespace digidoc
 {
 class SiVaContainer;
 class Exception;
+struct ZipProbe;
 
 class SignatureSiVa final: public Signature
 {
@@ -101,10 +102,12 @@ public:
 
     static std::unique_ptr<Container> createInternal(const std::string &path);
     static std::unique_ptr<Container> openInternal(const std::string &path, ContainerOpenCB *cb);
+    static std::unique_ptr<Container> openInternal(const ZipProbe &zip, ContainerOpenCB *cb);
 
 private:
     std::string path() const final;
-    SiVaContainer(const std::string &path, ContainerOpenCB *cb, bool useHashCode);
+    SiVaContainer(const std::string &path, ContainerOpenCB *cb, bool useHashCode, const ZipProbe *zip);
+    static std::unique_ptr<Container> open(const std::string &path, ContainerOpenCB *cb, const ZipProbe *zip);
     DISABLE_COPY(SiVaContainer);
 
     std::unique_ptr<std::istream> parseDDoc(const std::unique_ptr<std::istream> &ddoc, bool useHashCode);
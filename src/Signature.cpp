@@ -17,12 +17,14 @@
  *
  */
 
-#include "Signature.h"
+#include "Signature_p.h"
 
-#include "Exception.h"
+#include "Signature.h"
 #include "crypto/Signer.h"
 #include "crypto/X509Cert.h"
 
+#include "json.hpp"
+
 #include <algorithm>
 
 using namespace digidoc;
@@ -276,8 +278,88 @@ struct Signature::Validator::Private
     Status result = Valid;
     std::string diagnostics;
     std::vector<Exception::ExceptionCode> warnings;
+    std::vector<Check> checks;
 };
 
+static Signature::Validator::Status severity(Exception::ExceptionCode code)
+{
+    switch(code)
+    {
+    case Exception::ReferenceDigestWeak:
+    case Exception::SignatureDigestWeak:
+    case Exception::DataFileNameSpaceWarning:
+    case Exception::IssuerNameSpaceWarning:
+    case Exception::ProducedATLateWarning:
+    case Exception::MimeTypeWarning:
+        return Signature::Validator::Warning;
+    case Exception::CertificateIssuerMissing:
+    case Exception::CertificateUnknown:
+    case Exception::OCSPResponderMissing:
+    case Exception::OCSPCertMissing:
+        return Signature::Validator::Unknown;
+    default:
+        return Signature::Validator::Invalid;
+    }
+}
+
+static void severity(const Exception &e, Signature::Validator::Check &check)
+{
+    if(auto status = severity(e.code()); status > check.status)
+    {
+        check.status = status;
+        check.code = e.code();
+    }
+    for(const Exception &child: e.causes())
+        severity(child, check);
+}
+
+static string_view toString(Exception::ExceptionCode code)
+{
+    switch(code)
+    {
+    case Exception::General: return "General";
+    case Exception::NetworkError: return "NetworkError";
+    case Exception::HostNotFound: return "HostNotFound";
+    case Exception::InvalidUrl: return "InvalidUrl";
+    case Exception::CertificateIssuerMissing: return "CertificateIssuerMissing";
+    case Exception::CertificateRevoked: return "CertificateRevoked";
+    case Exception::CertificateUnknown: return "CertificateUnknown";
+    case Exception::OCSPBeforeTimeStamp: return "OCSPBeforeTimeStamp";
+    case Exception::OCSPResponderMissing: return "OCSPResponderMissing";
+    case Exception::OCSPCertMissing: return "OCSPCertMissing";
+    case Exception::OCSPTimeSlot: return "OCSPTimeSlot";
+    case Exception::OCSPRequestUnauthorized: return "OCSPRequestUnauthorized";
+    case Exception::TSForbidden: return "TSForbidden";
+    case Exception::TSTooManyRequests: return "TSTooManyRequests";
+    case Exception::PINCanceled: return "PINCanceled";
+    case Exception::PINFailed: return "PINFailed";
+    case Exception::PINIncorrect: return "PINIncorrect";
+    case Exception::PINLocked: return "PINLocked";
+    case Exception::ReferenceDigestWeak: return "ReferenceDigestWeak";
+    case Exception::SignatureDigestWeak: return "SignatureDigestWeak";
+    case Exception::DataFileNameSpaceWarning: return "DataFileNameSpaceWarning";
+    case Exception::IssuerNameSpaceWarning: return "IssuerNameSpaceWarning";
+    case Exception::ProducedATLateWarning: return "ProducedATLateWarning";
+    case Exception::MimeTypeWarning: return "MimeTypeWarning";
+    case Exception::DDocError: return "DDocError";
+    }
+    return "General";
+}
+
+static string_view toString(Signature::Validator::Status status)
+{
+    switch(status)
+    {
+    case Signature::Validator::Valid: return "Valid";
+    case Signature::Validator::Warning: return "Warning";
+    case Signature::Validator::NonQSCD: return "NonQSCD";
+    case Signature::Validator::Test: return "Test";
+    case Signature::Validator::Invalid: return "Invalid";
+    case Signature::Validator::Unknown: return "Unknown";
+    }
+    return "Unknown";
+}
+
 /**
  * @class digidoc::Signature::Validator
  * @since 3.13.8
@@ -302,6 +384,26 @@ struct Signature::Validator::Private
  * Signature validity is unknown (e.g. missing certificates).
  */
 
+/**
+ * @struct digidoc::Signature::Validator::Check
+ * @brief Result of one signature validation stage.
+ * @since 4.5.0
+ *
+ * Stages are named schema, properties, references, signingCertificate, timestamp, ocsp and
+ * archiveTimestamp, only stages relevant to the signature profile are reported.
+ *
+ * @var digidoc::Signature::Validator::Check::name
+ * Stage name.
+ * @var digidoc::Signature::Validator::Check::status
+ * Stage result, status is derived from stage problems same way as signature status.
+ * @var digidoc::Signature::Validator::Check::code
+ * Code of the problem that determined the status, General when stage passed.
+ * @var digidoc::Signature::Validator::Check::elapsed
+ * Time spent on stage. Schema is validated once per signature file when container is opened.
+ * @var digidoc::Signature::Validator::Check::cacheHits
+ * Process-wide caches reused by stage: schema, trustStore, issuerSignature.
+ */
+
 /**
  * Validates signature and initializes Validator object.
  * @param s Signature to validate.
@@ -309,6 +411,7 @@ struct Signature::Validator::Private
 Signature::Validator::Validator(const Signature *s)
     : d(new Private)
 {
+    ValidationCheck::Report report;
     try
     {
         s->validate();
@@ -319,6 +422,7 @@ Signature::Validator::Validator(const Signature *s)
     }
     if(d->result == Unknown)
     {
+        report.clear();
         try
         {
             d->result = NonQSCD;
@@ -329,6 +433,15 @@ Signature::Validator::Validator(const Signature *s)
             parseException(e);
         }
     }
+    d->checks.reserve(report.size());
+    for(const ValidationCheck::Record &record: report)
+    {
+        Check &check = d->checks.emplace_back(record.name, Valid, Exception::General, record.elapsed, record.cacheHits);
+        if(record.aborted)
+            check.status = Invalid;
+        for(const Exception &e: record.causes)
+            severity(e, check);
+    }
 }
 
 /**
@@ -339,6 +452,15 @@ Signature::Validator::~Validator()
     delete d;
 }
 
+/**
+ * Returns validation stages of the pass that determined signature status.
+ * @since 4.5.0
+ */
+std::vector<Signature::Validator::Check> Signature::Validator::checks() const
+{
+    return d->checks;
+}
+
 /**
  * Returns validation diagnostics.
  */
@@ -352,30 +474,45 @@ void Signature::Validator::parseException(const Exception &e)
     for(const Exception &child: e.causes())
     {
         d->diagnostics += child.msg() + "\n";
-        switch(child.code())
-        {
-        case Exception::ReferenceDigestWeak:
-        case Exception::SignatureDigestWeak:
-        case Exception::DataFileNameSpaceWarning:
-        case Exception::IssuerNameSpaceWarning:
-        case Exception::ProducedATLateWarning:
-        case Exception::MimeTypeWarning:
+        Status status = severity(child.code());
+        if(status == Warning)
             d->warnings.push_back(child.code());
-            d->result = std::max(d->result, Warning);
-            break;
-        case Exception::CertificateIssuerMissing:
-        case Exception::CertificateUnknown:
-        case Exception::OCSPResponderMissing:
-        case Exception::OCSPCertMissing:
-            d->result = std::max(d->result, Unknown);
-            break;
-        default:
-            d->result = std::max(d->result, Invalid);
-        }
+        d->result = std::max(d->result, status);
         parseException(child);
     }
 }
 
+/**
+ * Returns validation result as JSON object with status, warnings and stages with elapsed time in milliseconds.
+ * @since 4.5.0
+ * @see checks()
+ */
+std::string Signature::Validator::report() const
+{
+    using json = nlohmann::ordered_json;
+    json warnings = json::array();
+    for(Exception::ExceptionCode code: d->warnings)
+        warnings.push_back(toString(code));
+    json checks = json::array();
+    for(const Check &check: d->checks)
+    {
+        json item{
+            {"name", check.name},
+            {"status", toString(check.status)},
+        };
+        if(check.status != Valid)
+            item["code"] = toString(check.code);
+        item["elapsed"] = chrono::duration<double,milli>(check.elapsed).count();
+        item["cacheHits"] = check.cacheHits;
+        checks.push_back(std::move(item));
+    }
+    return json{
+        {"status", toString(d->result)},
+        {"warnings", std::move(warnings)},
+        {"checks", std::move(checks)},
+    }.dump();
+}
+
 /**
  * Returns validation status.
  */
@@ -23,6 +23,8 @@
 
 #include "crypto/X509Cert.h"
 
+#include <chrono>
+
 namespace digidoc
 {
     class Signer;
@@ -49,10 +51,21 @@ namespace digidoc
                 Unknown
             };
 
+            struct Check
+            {
+                std::string name;
+                Status status = Valid;
+                Exception::ExceptionCode code = Exception::General;
+                std::chrono::nanoseconds elapsed {};
+                std::vector<std::string> cacheHits;
+            };
+
             Validator(const Signature *s);
             ~Validator();
 
+            std::vector<Check> checks() const;
             std::string diagnostics() const;
+            std::string report() const;
             Status status() const;
             std::vector<Exception::ExceptionCode> warnings() const;
 
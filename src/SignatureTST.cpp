@@ -22,6 +22,7 @@
 #include "ASiC_S.h"
 #include "Conf.h"
 #include "DataFile_p.h"
+#include "Signature_p.h"
 #include "XMLDocument.h"
 #include "crypto/Digest.h"
 #include "crypto/Signer.h"
@@ -72,7 +73,7 @@ SignatureTST::SignatureTST(bool manifest, const ZipSerialize &z, ASiC_S *asicSDo
     timestampToken = make_unique<TS>((const unsigned char*)data.data(), data.size());
     if(manifest)
     {
-        XMLSchema schema(util::File::path(Conf::instance()->xsdPath(), "en_31916201v010101.xsd"));
+        const XMLSchema &schema = XMLSchema::cached(util::File::path(Conf::instance()->xsdPath(), "en_31916201v010101.xsd"));
         string file = "META-INF/ASiCArchiveManifest.xml";
         string mime = "text/xml";
         while(!file.empty()) {
@@ -221,6 +222,7 @@ void SignatureTST::validate() const
         throw exception;
     }
     const DataFile *file = asicSDoc->dataFiles().front();
+    ValidationCheck timestamp("timestamp", exception);
     try
     {
         auto digestMethod = signatureMethod();
@@ -237,6 +239,9 @@ void SignatureTST::validate() const
     {
         exception.addCause(e);
     }
+    timestamp.finish();
+
+    ValidationCheck archive("archiveTimestamp", exception);
     try
     {
         vector<string> list {file->fileName()};
@@ -289,6 +294,7 @@ void SignatureTST::validate() const
     {
         exception.addCause(e);
     }
+    archive.finish();
 
     if(!exception.causes().empty())
         throw exception;
@@ -174,17 +174,17 @@ int initXmlSecCallback()
                 return {};
             }
 
-            auto *is = static_cast<const DataFilePrivate*>(file)->m_is.get();
-            is->clear();
-            is->seekg(0);
-            return is;
+            return static_cast<const DataFilePrivate*>(file)->input().release();
         },
         [](void *ctx, char *buf, int len) -> int {
-            auto *is = static_cast<istream*>(ctx);
+            auto *is = static_cast<DataFilePrivate::Input*>(ctx)->is;
             is->read(buf, len);
-            return int(is->gcount());
+            // Content is hashed by the reference digest
+            MetricsPrivate::add(MetricsPrivate::DigestBytes, uint64_t(is->gcount()));
+            return is->bad() ? -1 : int(is->gcount());
         },
-        [](void */*ctx*/) -> int {
+        [](void *ctx) -> int {
+            delete static_cast<DataFilePrivate::Input*>(ctx);
             return 0;
         });
 }
@@ -208,11 +208,15 @@ Signatures::Signatures(XMLDocument &&doc, string_view mediaType)
      *
      * Case container is ADoc 1.0 then handle document-signatures root element
      */
+    ValidationCheck check("schema", schema);
     try {
+        bool cached = false;
         if(mediaType == ASiC_E::MIMETYPE_ADOC && name() == "document-signatures" && ns() == OPENDOCUMENT_NS)
-            validateSchema(File::path(Conf::instance()->xsdPath(), "OpenDocument_dsig.xsd"));
+            validateSchema(XMLSchema::cached(File::path(Conf::instance()->xsdPath(), "OpenDocument_dsig.xsd"), &cached));
         else
-            validateSchema(File::path(Conf::instance()->xsdPath(), "en_31916201v010101.xsd"));
+            validateSchema(XMLSchema::cached(File::path(Conf::instance()->xsdPath(), "en_31916201v010101.xsd"), &cached));
+        if(cached)
+            ValidationCheck::addCacheHit(MetricsPrivate::SchemaCache);
     }
     catch(const Exception &e) {
         THROW_CAUSE(e, "Failed to validate signature XML");
@@ -409,8 +413,10 @@ void SignatureXAdES_B::validate(const string &policy) const
     // A "master" exception containing all problems (causes) with this signature.
     // It'll be only thrown in case we have a reason (cause).
     Exception exception(EXCEPTION_PARAMS("Signature validation"));
+    ValidationCheck::add(signatures->schema);
 
     try {
+        ValidationCheck properties("properties", exception);
         if(!Exception::hasWarningIgnore(Exception::SignatureDigestWeak) &&
             Digest::isWeakDigest(signatureMethod()))
         {
@@ -450,7 +456,9 @@ void SignatureXAdES_B::validate(const string &policy) const
 #endif
             }
         }
+        properties.finish();
 
+        ValidationCheck references("references", exception);
         X509Cert cert = signingCertificate();
         cb_doc = bdoc;
         cb_exception = &exception;
@@ -544,7 +552,9 @@ void SignatureXAdES_B::validate(const string &policy) const
 
         if(!signatureref.empty())
             EXCEPTION_ADD(exception, "Manifest references and signature references do not match");
+        references.finish();
 
+        ValidationCheck certificate("signingCertificate", exception);
         try { checkKeyInfo(); }
         catch(const Exception& e) { exception.addCause(e); }
 
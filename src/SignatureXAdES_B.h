@@ -20,6 +20,7 @@
 #pragma once
 
 #include "Signature.h"
+#include "Signature_p.h"
 
 #include "XMLDocument.h"
 
@@ -46,6 +47,9 @@ namespace digidoc
         {
             return (*this)/XMLName{"Signature", DSIG_NS};
         }
+
+        // Schema validation of parsed document, reported for each signature it contains
+        ValidationCheck::Record schema;
     };
 
     class SignatureXAdES_B : public Signature
@@ -29,9 +29,11 @@
 #include "crypto/X509CertStore.h"
 #include "util/DateTime.h"
 #include "util/log.h"
+#include "util/ThreadPool.h"
 
 #include <algorithm>
 #include <ctime>
+#include <future>
 
 using namespace digidoc;
 using namespace std;
@@ -109,6 +111,7 @@ void SignatureXAdES_LT::validate(const string &policy) const
             exception.addCause(ex);
     }
 
+    ValidationCheck check("ocsp", exception);
     try {
         auto usp = unsignedSignatureProperties();
         if(!usp)
@@ -200,30 +203,45 @@ void SignatureXAdES_LT::validate(const string &policy) const
     } catch(...) {
         EXCEPTION_ADD(exception, "Failed to validate signature");
     }
+    check.finish();
     if(!exception.causes().empty())
         throw exception;
 }
 
 /**
+ * Extends signature to LT level. Issuer lookup, which may download certificate from AIA,
+ * is made concurrently with time-stamp request. OCSP request is made after time-stamp
+ * because LT level requires OCSP response produced after time-stamp.
  *
  * @throws SignatureException
  */
 void SignatureXAdES_LT::extendSignatureProfile(Signer *signer)
 {
-    SignatureXAdES_T::extendSignatureProfile(signer);
     if(signer->profile().find(ASiC_E::ASIC_TS_PROFILE) == string::npos)
-        return;
+        return SignatureXAdES_T::extendSignatureProfile(signer);
 
-    // Get issuer certificate from certificate store.
     X509Cert cert = signingCertificate();
-    X509Cert issuer = X509CertStore::instance()->findIssuer(cert, X509CertStore::CA);
-    if(!issuer)
-        issuer = X509CertStore::issuerFromAIA(cert);
-    if(!issuer)
-        THROW("Could not find certificate issuer '%s' in certificate store or from AIA.",
-            cert.issuerName().c_str());
+    util::ThreadPool::Group pool;
+    auto lookup = pool.submit([&cert] {
+        // Get issuer certificate from certificate store.
+        X509Cert issuer = X509CertStore::instance()->findIssuer(cert, X509CertStore::CA);
+        if(!issuer)
+            issuer = X509CertStore::issuerFromAIA(cert);
+        if(!issuer)
+            THROW("Could not find certificate issuer '%s' in certificate store or from AIA.",
+                cert.issuerName().c_str());
+        return issuer;
+    });
+    try {
+        SignatureXAdES_T::extendSignatureProfile(signer);
+    } catch(...) {
+        // Request refers to local variables
+        try { pool.wait(lookup); } catch(...) {}
+        throw;
+    }
+    X509Cert issuer = pool.wait(lookup);
 
-    OCSP ocsp(cert, issuer, signer->userAgent());
+    OCSP ocsp(cert, issuer, signer->userAgent(), TimeStamp().time());
     ocsp.verifyResponse(cert);
 
     addCertificateValue(id() + "-CA-CERT", issuer);
@@ -134,6 +134,7 @@ void SignatureXAdES_LTA::validate(const string &policy) const
         return;
     }
 
+    ValidationCheck check("archiveTimestamp", exception);
     try {
         for(auto ts = unsignedSignatureProperties()/ArchiveTimeStamp; ts; ts++)
         {
@@ -146,6 +147,7 @@ void SignatureXAdES_LTA::validate(const string &policy) const
     } catch(...) {
         EXCEPTION_ADD(exception, "Failed to validate signature");
     }
+    check.finish();
     if(!exception.causes().empty())
         throw exception;
 }
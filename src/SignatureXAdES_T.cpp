@@ -99,6 +99,7 @@ void SignatureXAdES_T::validate(const std::string &policy) const
             exception.addCause(ex);
     }
 
+    ValidationCheck check("timestamp", exception);
     try {
         auto usp = unsignedSignatureProperties();
         if(!usp)
@@ -180,6 +181,7 @@ void SignatureXAdES_T::validate(const std::string &policy) const
     } catch(...) {
         EXCEPTION_ADD(exception, "Failed to validate signature");
     }
+    check.finish();
     if(!exception.causes().empty())
         throw exception;
 }
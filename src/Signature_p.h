@@ -0,0 +1,160 @@
+/*
+ * libdigidocpp
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+
+#include "Exception.h"
+#include "Metrics_p.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace digidoc
+{
+
+/**
+ * Measures one stage of signature validation on current thread. Problems added to the signature
+ * exception while the check is running are its result, exception escaping the check marks it
+ * failed. Checks are recorded only while Report is active or into explicitly given Record.
+ */
+class ValidationCheck
+{
+public:
+    struct Record
+    {
+        std::string name;
+        std::vector<Exception> causes;
+        std::chrono::nanoseconds elapsed {};
+        std::vector<std::string> cacheHits;
+        bool aborted = false;
+    };
+
+    class Report: public std::vector<Record>
+    {
+    public:
+        Report() noexcept: previous(std::exchange(active, this)) {}
+        ~Report() noexcept { active = previous; }
+
+    private:
+        DISABLE_COPY(Report);
+        Report *previous;
+    };
+
+    ValidationCheck(std::string name, const Exception &exception)
+        : ValidationCheck(std::move(name), &exception, active, nullptr)
+    {}
+
+    ValidationCheck(std::string name, Record &target)
+        : ValidationCheck(std::move(name), nullptr, nullptr, &target)
+    {}
+
+    ~ValidationCheck() noexcept
+    {
+        finish();
+    }
+
+    void finish() noexcept
+    {
+        if(current == this)
+            current = parent;
+        if(!report && !target)
+            return;
+        try {
+            record.elapsed = std::chrono::steady_clock::now() - begin;
+            record.aborted = std::uncaught_exceptions() > exceptions;
+            if(exception)
+            {
+                Exception::Causes list = exception->causes();
+                record.causes.assign(list.begin() + std::ptrdiff_t(causes), list.end());
+            }
+            if(target)
+                *target = std::move(record);
+            else
+                report->push_back(std::move(record));
+        } catch(...) {}
+        report = {};
+        target = {};
+    }
+
+    /**
+     * Records reuse of cached data by innermost running check.
+     */
+    static void cacheHit(MetricsPrivate::Cache cache)
+    {
+        MetricsPrivate::cache(cache, true);
+        addCacheHit(cache);
+    }
+
+    /**
+     * Records reuse of cached data already counted in metrics by innermost running check.
+     */
+    static void addCacheHit(MetricsPrivate::Cache cache)
+    {
+        if(!current)
+            return;
+        auto &hits = current->record.cacheHits;
+        if(const char *name = MetricsPrivate::CACHES[cache]; std::find(hits.cbegin(), hits.cend(), name) == hits.cend())
+            hits.emplace_back(name);
+    }
+
+    /**
+     * Adds check recorded earlier, eg. while signature was parsed, to active report.
+     */
+    static void add(const Record &record)
+    {
+        if(active && !record.name.empty())
+            active->push_back(record);
+    }
+
+private:
+    DISABLE_COPY(ValidationCheck);
+
+    ValidationCheck(std::string &&name, const Exception *exception, Report *report, Record *target)
+        : report(report)
+        , target(target)
+        , exception(exception)
+    {
+        if(!report && !target)
+            return;
+        record.name = std::move(name);
+        parent = std::exchange(current, this);
+        if(exception)
+            causes = exception->causes().size();
+        exceptions = std::uncaught_exceptions();
+        begin = std::chrono::steady_clock::now();
+    }
+
+    Record record;
+    Report *report {};
+    Record *target {};
+    ValidationCheck *parent {};
+    const Exception *exception {};
+    size_t causes = 0;
+    int exceptions = 0;
+    std::chrono::steady_clock::time_point begin;
+
+    static inline thread_local Report *active {};
+    static inline thread_local ValidationCheck *current {};
+};
+
+}
@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include "Metrics_p.h"
 #include "crypto/Digest.h"
 #include "crypto/X509Cert.h"
 #include "util/log.h"
@@ -39,7 +40,10 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <fstream>
+#include <map>
+#include <mutex>
 
 namespace digidoc {
 
@@ -489,6 +493,8 @@ struct XMLDocument: public unique_free_d<xmlFreeDoc>, public XMLNode
         }
         else if(!algo.empty())
             THROW("Unsupported canonicalization method '%.*s'", int(algo.size()), algo.data());
+        MetricsPrivate::Timer timer(MetricsPrivate::C14NTime);
+        MetricsPrivate::add(MetricsPrivate::C14NCount, 1);
         auto buf = make_unique_ptr<xmlOutputBufferClose>(xmlOutputBufferCreateIO([](void *context, const char *buffer, int len) {
             auto *digest = static_cast<Digest *>(context);
             digest->update(pcxmlChar(buffer), size_t(len));
@@ -555,6 +561,8 @@ struct XMLDocument: public unique_free_d<xmlFreeDoc>, public XMLNode
         if(xmlSecKeySetValue(key.get(), data.get()) < 0) return false;
         data.release(); // key owns data now
         ctx->signKey = key.release(); // ctx owns key, freed by xmlSecDSigCtxDestroy
+        MetricsPrivate::add(MetricsPrivate::VerifyCount, 1);
+        MetricsPrivate::Timer timer(MetricsPrivate::VerifyTime);
         int result = xmlSecDSigCtxVerify(ctx.get(), signature.d);
 #if VERSION_CHECK(XMLSEC_VERSION_MAJOR, XMLSEC_VERSION_MINOR, XMLSEC_VERSION_SUBMINOR) >= VERSION_CHECK(1, 3, 0)
         if(ctx->failureReason == xmlSecDSigFailureReasonReference)
@@ -598,14 +606,78 @@ struct XMLSchema
     {
     }
 
+    static auto& cache()
+    {
+        static std::pair<std::mutex,std::map<std::string,std::unique_ptr<XMLSchema>,std::less<>>> cache;
+        return cache;
+    }
+
+    /**
+     * Returns process-wide compiled schema, XSD set is parsed once on first use of the path.
+     * Shared schema keeps validation context per thread.
+     *
+     * @param hit set to true when schema was already compiled.
+     */
+    static const XMLSchema& cached(const std::string &path, bool *hit = nullptr)
+    {
+        auto &[m, schemas] = cache();
+        std::scoped_lock lock(m);
+        auto &schema = schemas[path];
+        MetricsPrivate::cache(MetricsPrivate::SchemaCache, bool(schema));
+        if(hit)
+            *hit = bool(schema);
+        if(!schema)
+        {
+            schema = std::make_unique<XMLSchema>(path);
+            schema->shared = true;
+        }
+        return *schema;
+    }
+
+    /**
+     * Releases compiled schemas, they are not valid after libxml2 cleanup on library termination.
+     */
+    static void clearCache()
+    {
+        auto &[m, schemas] = cache();
+        std::scoped_lock lock(m);
+        schemas.clear();
+        ++generation();
+    }
+
+    /**
+     * Cache generation, advanced on clearCache. Per thread validation contexts of older generation
+     * refer to released schemas and are dropped on next validation.
+     */
+    static std::atomic<uint64_t>& generation() noexcept
+    {
+        static std::atomic<uint64_t> generation {0};
+        return generation;
+    }
+
     void validate(const XMLDocument &doc) const
     {
-        auto validate = make_unique_ptr<xmlSchemaFreeValidCtxt>(xmlSchemaNewValidCtxt(d.get()));
+        // Keyed by id, address of released schema may be reused
+        thread_local struct {
+            uint64_t generation = 0;
+            std::map<uint64_t,unique_free_d<xmlSchemaFreeValidCtxt>> contexts;
+        } thread;
+        if(uint64_t current = generation(); thread.generation != current)
+        {
+            thread.contexts.clear();
+            thread.generation = current;
+        }
+        unique_free_d<xmlSchemaFreeValidCtxt> local;
+        auto &validate = shared ? thread.contexts[id] : local;
+        if(!validate)
+            validate.reset(xmlSchemaNewValidCtxt(d.get()));
         if(!validate)
             THROW("Failed to create schema validation context");
         Exception e(EXCEPTION_PARAMS("Failed to validate XML with schema"));
         xmlSchemaSetValidErrors(validate.get(), schemaValidationError, schemaValidationWarning, &e);
-        if(xmlSchemaValidateDoc(validate.get(), doc.get()) != 0)
+        int result = xmlSchemaValidateDoc(validate.get(), doc.get());
+        xmlSchemaSetValidErrors(validate.get(), schemaValidationError, schemaValidationWarning, nullptr);
+        if(result != 0)
             throw e;
     }
 
@@ -638,6 +710,15 @@ struct XMLSchema
     }
 
     unique_free_d<xmlSchemaFree> d;
+    bool shared = false;
+    uint64_t id = nextId();
+
+private:
+    static uint64_t nextId() noexcept
+    {
+        static std::atomic<uint64_t> ids {0};
+        return ++ids;
+    }
 };
 
 inline void XMLDocument::validateSchema(const XMLSchema &schema) const
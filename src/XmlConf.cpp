@@ -22,6 +22,7 @@
 #include "XMLDocument.h"
 #include "crypto/X509Cert.h"
 #include "util/File.h"
+#include "util/algorithm.h"
 
 #include <map>
 #include <optional>
@@ -60,6 +61,14 @@ class XmlConf::Private
 public:
     Private(Conf *self, const string &path, string schema);
 
+    // Version 6 parameters are read only by XmlConfV6, earlier versions get the same defaults
+    static const ConfV6* v6(const Conf *self)
+    {
+        static const ConfV6 defaults;
+        const auto *conf = dynamic_cast<const ConfV6*>(self);
+        return conf ? conf : &defaults;
+    }
+
     auto loadDoc(const string &path) const;
     void init(const string &path, bool global);
     template <class A>
@@ -82,8 +91,18 @@ public:
     XmlConfParam<bool> TSLOnlineDigest;
     XmlConfParam<int> TSLTimeOut;
     XmlConfParam<string> verifyServiceUri;
+    XmlConfParam<int> compressionLevel;
+    XmlConfParam<bool> compressionProbe;
+    XmlConfParam<int> TSLRefreshInterval;
+    XmlConfParam<int> threadPoolSize;
+    XmlConfParam<bool> OCSPCache;
+    XmlConfParam<string> OCSPCachePath;
+    XmlConfParam<int> connectionPoolSize;
+    XmlConfParam<int> connectionIdleTimeout;
     map<string,string> ocsp;
     set<string> ocspTMProfiles;
+    set<string> compressionSkipExtensions;
+    set<string> compressionSkipMediaTypes;
 
     string SCHEMA_LOC;
     static const string USER_CONF_LOC;
@@ -110,6 +129,14 @@ XmlConf::Private::Private(Conf *self, const string &path, string schema)
     , TSLOnlineDigest{"tsl.onlineDigest", self->Conf::TSLOnlineDigest()}
     , TSLTimeOut{"tsl.timeOut", self->Conf::TSLTimeOut()}
     , verifyServiceUri{"verify.serivceUri", self->Conf::verifyServiceUri()}
+    , compressionLevel{"compression.level", v6(self)->ConfV6::compressionLevel()}
+    , compressionProbe{"compression.probe", v6(self)->ConfV6::compressionProbe()}
+    , TSLRefreshInterval{"tsl.refreshInterval", v6(self)->ConfV6::TSLRefreshInterval()}
+    , threadPoolSize{"threadpool.size", v6(self)->ConfV6::threadPoolSize()}
+    , OCSPCache{"ocsp.cache", v6(self)->ConfV6::OCSPCache()}
+    , OCSPCachePath{"ocsp.cache.path", v6(self)->ConfV6::OCSPCachePath()}
+    , connectionPoolSize{"connection.pool.size", v6(self)->ConfV6::connectionPoolSize()}
+    , connectionIdleTimeout{"connection.pool.idleTimeout", v6(self)->ConfV6::connectionIdleTimeout()}
     , SCHEMA_LOC(std::move(schema))
 {
     if(path.empty())
@@ -198,10 +225,22 @@ void XmlConf::Private::init(const string& path, bool global)
             setValue(TSLCache) ||
             setValue(TSLOnlineDigest) ||
             setValue(TSLTimeOut) ||
-            setValue(verifyServiceUri))
+            setValue(verifyServiceUri) ||
+            setValue(compressionLevel) ||
+            setValue(compressionProbe) ||
+            setValue(TSLRefreshInterval) ||
+            setValue(threadPoolSize) ||
+            setValue(OCSPCache) ||
+            setValue(OCSPCachePath) ||
+            setValue(connectionPoolSize) ||
+            setValue(connectionIdleTimeout))
             continue;
         if(paramName == "ocsp.tm.profile" && global)
             ocspTMProfiles.emplace(value);
+        if(paramName == "compression.skip.extension" && global)
+            compressionSkipExtensions.emplace(to_lower(string(value)));
+        if(paramName == "compression.skip.mediaType" && global)
+            compressionSkipMediaTypes.emplace(to_lower(string(value)));
     }
 }
 
@@ -257,13 +296,13 @@ void XmlConf::Private::setUserConf(XmlConfParam<A> &param, A value)
 
 /**
  * @typedef digidoc::XmlConfCurrent
- * Reference to latest XmlConfV5 class
+ * Reference to latest XmlConfV6 class
  */
 
 /**
  * @class digidoc::XmlConf
  * @brief XML Configuration class
- * @deprecated Since 3.12.2, use digidoc::XmlConfV5
+ * @deprecated Since 3.12.2, use digidoc::XmlConfV6
  * @see digidoc::Conf
  */
 XmlConf::XmlConf(const string &path, const string &schema)
@@ -280,7 +319,7 @@ XmlConf* XmlConf::instance() { return dynamic_cast<XmlConf*>(Conf::instance());
  * @class digidoc::XmlConfV2
  * @brief Version 2 of XML Configuration class
  * @since 3.12.2
- * @deprecated Since 3.13.8, use digidoc::XmlConfV5
+ * @deprecated Since 3.13.8, use digidoc::XmlConfV6
  * @see digidoc::ConfV2
  */
 XmlConfV2::XmlConfV2(const string &path, const string &schema)
@@ -297,7 +336,7 @@ XmlConfV2* XmlConfV2::instance() { return dynamic_cast<XmlConfV2*>(Conf::instanc
  * @class digidoc::XmlConfV3
  * @brief Version 3 of XML Configuration class
  * @since 3.13.8
- * @deprecated Since 3.14.7, use digidoc::XmlConfV5
+ * @deprecated Since 3.14.7, use digidoc::XmlConfV6
  * @see digidoc::ConfV3
  */
 XmlConfV3::XmlConfV3(const string &path, const string &schema)
@@ -314,7 +353,7 @@ XmlConfV3* XmlConfV3::instance() { return dynamic_cast<XmlConfV3*>(Conf::instanc
  * @class digidoc::XmlConfV4
  * @brief Version 4 of XML Configuration class
  * @since 3.14.7
- * @deprecated Since 3.15.0, use digidoc::XmlConfV5
+ * @deprecated Since 3.15.0, use digidoc::XmlConfV6
  * @see digidoc::ConfV4
  */
 /**
@@ -334,6 +373,7 @@ XmlConfV4* XmlConfV4::instance() { return dynamic_cast<XmlConfV4*>(Conf::instanc
  * @class digidoc::XmlConfV5
  * @brief Version 5 of XML Configuration class
  * @since 3.15.0
+ * @deprecated Since 4.5.0, use digidoc::XmlConfV6
  * @see digidoc::ConfV5
  */
 /**
@@ -349,6 +389,25 @@ XmlConfV5::~XmlConfV5() = default;
  */
 XmlConfV5* XmlConfV5::instance() { return dynamic_cast<XmlConfV5*>(Conf::instance()); }
 
+/**
+ * @class digidoc::XmlConfV6
+ * @brief Version 6 of XML Configuration class
+ * @since 4.5.0
+ * @see digidoc::ConfV6
+ */
+/**
+ * Initialize xml conf from path
+ */
+XmlConfV6::XmlConfV6(const string &path, const string &schema)
+    : d(make_unique<XmlConf::Private>(this, path, schema.empty() ? File::path(xsdPath(), "conf.xsd") : schema))
+{}
+XmlConfV6::~XmlConfV6() = default;
+
+/**
+ * @copydoc digidoc::Conf::instance()
+ */
+XmlConfV6* XmlConfV6::instance() { return dynamic_cast<XmlConfV6*>(Conf::instance()); }
+
 
 
 #define GET1EX(TYPE, PROP, VALUE) \
@@ -356,7 +415,8 @@ TYPE XmlConf::PROP() const { return VALUE; } \
 TYPE XmlConfV2::PROP() const { return VALUE; } \
 TYPE XmlConfV3::PROP() const { return VALUE; } \
 TYPE XmlConfV4::PROP() const { return VALUE; } \
-TYPE XmlConfV5::PROP() const { return VALUE; }
+TYPE XmlConfV5::PROP() const { return VALUE; } \
+TYPE XmlConfV6::PROP() const { return VALUE; }
 
 #define GET1(TYPE, PROP) \
 GET1EX(TYPE, PROP, d->PROP.value_or(d->PROP.defaultValue))
@@ -366,7 +426,8 @@ void XmlConf::SET(TYPE value) { VALUE; } \
 void XmlConfV2::SET(TYPE value) { VALUE; } \
 void XmlConfV3::SET(TYPE value) { VALUE; } \
 void XmlConfV4::SET(TYPE value) { VALUE; } \
-void XmlConfV5::SET(TYPE value) { VALUE; }
+void XmlConfV5::SET(TYPE value) { VALUE; } \
+void XmlConfV6::SET(TYPE value) { VALUE; }
 
 #define SET1(TYPE, SET, PROP) \
 SET1EX(TYPE, SET, d->setUserConf(d->PROP, value))
@@ -376,7 +437,8 @@ void XmlConf::SET(const TYPE &value) { VALUE; } \
 void XmlConfV2::SET(const TYPE &value) { VALUE; } \
 void XmlConfV3::SET(const TYPE &value) { VALUE; } \
 void XmlConfV4::SET(const TYPE &value) { VALUE; } \
-void XmlConfV5::SET(const TYPE &value) { VALUE; }
+void XmlConfV5::SET(const TYPE &value) { VALUE; } \
+void XmlConfV6::SET(const TYPE &value) { VALUE; }
 
 #define SET1CONST(TYPE, SET, PROP) \
 SET1CONSTEX(TYPE, SET, d->setUserConf(d->PROP, value))
@@ -447,6 +509,15 @@ string XmlConfV5::ocsp(const string &issuer) const
     return i != d->ocsp.end() ? i->second : Conf::ocsp(issuer);
 }
 
+/**
+ * @since 4.5.0
+ */
+string XmlConfV6::ocsp(const string &issuer) const
+{
+    auto i = d->ocsp.find(issuer);
+    return i != d->ocsp.end() ? i->second : Conf::ocsp(issuer);
+}
+
 /**
  * @fn void digidoc::XmlConf::setTSLOnlineDigest(bool enable)
  * Enables/Disables online digest check
@@ -472,6 +543,11 @@ string XmlConfV5::ocsp(const string &issuer) const
  * @copydoc digidoc::XmlConf::setTSLOnlineDigest(bool enable)
  * @since 3.15.0
  */
+/**
+ * @fn void digidoc::XmlConfV6::setTSLOnlineDigest(bool enable)
+ * @copydoc digidoc::XmlConf::setTSLOnlineDigest(bool enable)
+ * @since 4.5.0
+ */
 SET1(bool, setTSLOnlineDigest, TSLOnlineDigest)
 
 /**
@@ -500,6 +576,11 @@ SET1(bool, setTSLOnlineDigest, TSLOnlineDigest)
  * @copydoc digidoc::XmlConf::setTSLTimeOut(int timeOut)
  * @since 3.15.0
  */
+/**
+ * @fn void digidoc::XmlConfV6::setTSLTimeOut(int timeOut)
+ * @copydoc digidoc::XmlConf::setTSLTimeOut(int timeOut)
+ * @since 4.5.0
+ */
 SET1(int, setTSLTimeOut, TSLTimeOut)
 
 /**
@@ -529,6 +610,11 @@ SET1(int, setTSLTimeOut, TSLTimeOut)
  * @copydoc digidoc::XmlConf::setProxyHost(const std::string &host)
  * @since 3.15.0
  */
+/**
+ * @fn void digidoc::XmlConfV6::setProxyHost(const std::string &host)
+ * @copydoc digidoc::XmlConf::setProxyHost(const std::string &host)
+ * @since 4.5.0
+ */
 SET1CONST(string, setProxyHost, proxyHost)
 
 /**
@@ -558,6 +644,11 @@ SET1CONST(string, setProxyHost, proxyHost)
  * @copydoc digidoc::XmlConf::setProxyPort(const std::string &port)
  * @since 3.15.0
  */
+/**
+ * @fn void digidoc::XmlConfV6::setProxyPort(const std::string &port)
+ * @copydoc digidoc::XmlConf::setProxyPort(const std::string &port)
+ * @since 4.5.0
+ */
 SET1CONST(string, setProxyPort, proxyPort)
 
 /**
@@ -587,6 +678,11 @@ SET1CONST(string, setProxyPort, proxyPort)
  * @copydoc digidoc::XmlConf::setProxyUser(const std::string &user)
  * @since 3.15.0
  */
+/**
+ * @fn void digidoc::XmlConfV6::setProxyUser(const std::string &user)
+ * @copydoc digidoc::XmlConf::setProxyUser(const std::string &user)
+ * @since 4.5.0
+ */
 SET1CONST(string, setProxyUser, proxyUser)
 
 /**
@@ -616,6 +712,11 @@ SET1CONST(string, setProxyUser, proxyUser)
  * @copydoc digidoc::XmlConf::setProxyPass(const std::string &pass)
  * @since 3.15.0
  */
+/**
+ * @fn void digidoc::XmlConfV6::setProxyPass(const std::string &pass)
+ * @copydoc digidoc::XmlConf::setProxyPass(const std::string &pass)
+ * @since 4.5.0
+ */
 SET1CONST(string, setProxyPass, proxyPass)
 
 /**
@@ -647,6 +748,11 @@ SET1CONST(string, setProxyPass, proxyPass)
  * @copydoc digidoc::XmlConf::setPKCS12Cert(const std::string &cert)
  * @since 3.15.0
  */
+/**
+ * @fn void digidoc::XmlConfV6::setPKCS12Cert(const std::string &cert)
+ * @copydoc digidoc::XmlConf::setPKCS12Cert(const std::string &cert)
+ * @since 4.5.0
+ */
 SET1CONSTEX(string, setPKCS12Cert, (void)value)
 
 /**
@@ -677,6 +783,11 @@ SET1CONSTEX(string, setPKCS12Cert, (void)value)
  * @copydoc digidoc::XmlConf::setPKCS12Pass(const std::string &pass)
  * @since 3.15.0
  */
+/**
+ * @fn void digidoc::XmlConfV6::setPKCS12Pass(const std::string &pass)
+ * @copydoc digidoc::XmlConf::setPKCS12Pass(const std::string &pass)
+ * @since 4.5.0
+ */
 SET1CONSTEX(string, setPKCS12Pass, (void)value)
 
 /**
@@ -706,6 +817,11 @@ SET1CONSTEX(string, setPKCS12Pass, (void)value)
  * @copydoc digidoc::XmlConf::setTSUrl(const std::string &url)
  * @since 3.15.0
  */
+/**
+ * @fn void digidoc::XmlConfV6::setTSUrl(const std::string &url)
+ * @copydoc digidoc::XmlConf::setTSUrl(const std::string &url)
+ * @since 4.5.0
+ */
 SET1CONST(string, setTSUrl, TSUrl)
 
 /**
@@ -735,6 +851,11 @@ SET1CONST(string, setTSUrl, TSUrl)
  * @copydoc digidoc::XmlConf::setVerifyServiceUri(const std::string &url)
  * @since 3.15.0
  */
+/**
+ * @fn void digidoc::XmlConfV6::setVerifyServiceUri(const std::string &url)
+ * @copydoc digidoc::XmlConf::setVerifyServiceUri(const std::string &url)
+ * @since 4.5.0
+ */
 SET1CONST(string, setVerifyServiceUri, verifyServiceUri)
 
 /**
@@ -765,6 +886,11 @@ SET1CONST(string, setVerifyServiceUri, verifyServiceUri)
  * @copydoc digidoc::XmlConf::setPKCS12Disable(bool disable)
  * @since 3.15.0
  */
+/**
+ * @fn void digidoc::XmlConfV6::setPKCS12Disable(bool disable)
+ * @copydoc digidoc::XmlConf::setPKCS12Disable(bool disable)
+ * @since 4.5.0
+ */
 SET1EX([[maybe_unused]] bool, setPKCS12Disable, {})
 
 /**
@@ -793,6 +919,11 @@ SET1EX([[maybe_unused]] bool, setPKCS12Disable, {})
  * @copydoc digidoc::XmlConf::setProxyTunnelSSL(bool enable)
  * @since 3.15.0
  */
+/**
+ * @fn void digidoc::XmlConfV6::setProxyTunnelSSL(bool enable)
+ * @copydoc digidoc::XmlConf::setProxyTunnelSSL(bool enable)
+ * @since 4.5.0
+ */
 SET1(bool, setProxyTunnelSSL, proxyTunnelSSL)
 
 
@@ -828,6 +959,14 @@ X509Cert XmlConfV5::verifyServiceCert() const
     return ConfV5::verifyServiceCert();
 }
 
+/**
+ * @since 4.5.0
+ */
+X509Cert XmlConfV6::verifyServiceCert() const
+{
+    return ConfV6::verifyServiceCert();
+}
+
 /**
  * @since 3.13.8
  */
@@ -852,6 +991,14 @@ set<string> XmlConfV5::OCSPTMProfiles() const
     return d->ocspTMProfiles.empty() ? ConfV3::OCSPTMProfiles() : d->ocspTMProfiles;
 }
 
+/**
+ * @since 4.5.0
+ */
+set<string> XmlConfV6::OCSPTMProfiles() const
+{
+    return d->ocspTMProfiles.empty() ? ConfV3::OCSPTMProfiles() : d->ocspTMProfiles;
+}
+
 /**
  * @since 3.14.7
  */
@@ -868,6 +1015,14 @@ vector<X509Cert> XmlConfV5::verifyServiceCerts() const
     return ConfV5::verifyServiceCerts();
 }
 
+/**
+ * @since 4.5.0
+ */
+vector<X509Cert> XmlConfV6::verifyServiceCerts() const
+{
+    return ConfV6::verifyServiceCerts();
+}
+
 /**
  * @since 3.15.0
  */
@@ -875,3 +1030,115 @@ vector<X509Cert> XmlConfV5::TSCerts() const
 {
     return ConfV5::TSCerts();
 }
+
+/**
+ * @since 4.5.0
+ */
+vector<X509Cert> XmlConfV6::TSCerts() const
+{
+    return ConfV6::TSCerts();
+}
+
+/**
+ * @since 4.5.0
+ */
+int XmlConfV6::compressionLevel() const
+{
+    return d->compressionLevel.value_or(d->compressionLevel.defaultValue);
+}
+
+/**
+ * @since 4.5.0
+ */
+bool XmlConfV6::compressionProbe() const
+{
+    return d->compressionProbe.value_or(d->compressionProbe.defaultValue);
+}
+
+/**
+ * @since 4.5.0
+ */
+set<string> XmlConfV6::compressionSkipExtensions() const
+{
+    return d->compressionSkipExtensions.empty() ? ConfV6::compressionSkipExtensions() : d->compressionSkipExtensions;
+}
+
+/**
+ * @since 4.5.0
+ */
+set<string> XmlConfV6::compressionSkipMediaTypes() const
+{
+    return d->compressionSkipMediaTypes.empty() ? ConfV6::compressionSkipMediaTypes() : d->compressionSkipMediaTypes;
+}
+
+/**
+ * @since 4.5.0
+ */
+int XmlConfV6::TSLRefreshInterval() const
+{
+    return d->TSLRefreshInterval.value_or(d->TSLRefreshInterval.defaultValue);
+}
+
+/**
+ * @since 4.5.0
+ */
+int XmlConfV6::threadPoolSize() const
+{
+    return d->threadPoolSize.value_or(d->threadPoolSize.defaultValue);
+}
+
+/**
+ * @since 4.5.0
+ */
+bool XmlConfV6::OCSPCache() const
+{
+    return d->OCSPCache.value_or(d->OCSPCache.defaultValue);
+}
+
+/**
+ * @since 4.5.0
+ */
+string XmlConfV6::OCSPCachePath() const
+{
+    return d->OCSPCachePath.value_or(d->OCSPCachePath.defaultValue);
+}
+
+/**
+ * @since 4.5.0
+ */
+int XmlConfV6::connectionPoolSize() const
+{
+    return d->connectionPoolSize.value_or(d->connectionPoolSize.defaultValue);
+}
+
+/**
+ * @since 4.5.0
+ */
+int XmlConfV6::connectionIdleTimeout() const
+{
+    return d->connectionIdleTimeout.value_or(d->connectionIdleTimeout.defaultValue);
+}
+
+/**
+ * Sets compression level of container documents. Also adds or replaces compression level in the user configuration file.
+ *
+ * @param level -1 for zlib default level, 0 to store documents without compression and 1-9 from fastest to best compression.
+ * @throws Exception exception is thrown if saving a compression level into a user configuration file fails.
+ * @since 4.5.0
+ */
+void XmlConfV6::setCompressionLevel(int level)
+{
+    d->setUserConf(d->compressionLevel, level);
+}
+
+/**
+ * Enables/Disables probing container documents for already compressed data.
+ * Also adds or replaces the value in the user configuration file.
+ *
+ * @throws Exception exception is thrown if saving into a user configuration file fails.
+ * @since 4.5.0
+ */
+void XmlConfV6::setCompressionProbe(bool enable)
+{
+    d->setUserConf(d->compressionProbe, enable);
+}
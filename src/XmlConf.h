@@ -83,6 +83,7 @@ private:
     friend class XmlConfV3;
     friend class XmlConfV4;
     friend class XmlConfV5;
+    friend class XmlConfV6;
 };
 
 class DIGIDOCPP_EXPORT XmlConfV2: public ConfV2
@@ -311,5 +312,78 @@ private:
     std::unique_ptr<XmlConf::Private> d;
 };
 
-using XmlConfCurrent = XmlConfV5;
+class DIGIDOCPP_EXPORT XmlConfV6: public ConfV6
+{
+public:
+    explicit XmlConfV6(const std::string &path = {}, const std::string &schema = {});
+    ~XmlConfV6() override;
+    static XmlConfV6* instance();
+
+    int logLevel() const override;
+    std::string logFile() const override;
+    std::string PKCS11Driver() const override;
+
+    std::string proxyHost() const override;
+    std::string proxyPort() const override;
+    std::string proxyUser() const override;
+    std::string proxyPass() const override;
+    bool proxyForceSSL() const override;
+    bool proxyTunnelSSL() const override;
+
+    std::string digestUri() const override;
+    std::string signatureDigestUri() const override;
+    std::string ocsp(const std::string &issuer) const override;
+    std::set<std::string> OCSPTMProfiles() const override;
+    std::vector<X509Cert> TSCerts() const override;
+    std::string TSUrl() const override;
+    X509Cert verifyServiceCert() const override;
+    std::vector<X509Cert> verifyServiceCerts() const override;
+    std::string verifyServiceUri() const override;
+
+    DIGIDOCPP_DEPRECATED std::string PKCS12Cert() const override;
+    DIGIDOCPP_DEPRECATED std::string PKCS12Pass() const override;
+    DIGIDOCPP_DEPRECATED bool PKCS12Disable() const override;
+
+    bool TSLAutoUpdate() const override;
+    std::string TSLCache() const override;
+    bool TSLOnlineDigest() const override;
+    int TSLTimeOut() const override;
+
+    int compressionLevel() const override;
+    bool compressionProbe() const override;
+    std::set<std::string> compressionSkipExtensions() const override;
+    std::set<std::string> compressionSkipMediaTypes() const override;
+
+    int TSLRefreshInterval() const override;
+    int threadPoolSize() const override;
+    bool OCSPCache() const override;
+    std::string OCSPCachePath() const override;
+    int connectionPoolSize() const override;
+    int connectionIdleTimeout() const override;
+
+    virtual void setProxyHost( const std::string &host );
+    virtual void setProxyPort( const std::string &port );
+    virtual void setProxyUser( const std::string &user );
+    virtual void setProxyPass( const std::string &pass );
+    virtual void setProxyTunnelSSL( bool enable );
+    DIGIDOCPP_DEPRECATED virtual void setPKCS12Cert( const std::string &cert );
+    DIGIDOCPP_DEPRECATED virtual void setPKCS12Pass( const std::string &pass );
+    DIGIDOCPP_DEPRECATED virtual void setPKCS12Disable( bool disable );
+
+    virtual void setTSLOnlineDigest( bool enable );
+    virtual void setTSLTimeOut( int timeOut );
+
+    virtual void setTSUrl(const std::string &url);
+    virtual void setVerifyServiceUri(const std::string &url);
+
+    virtual void setCompressionLevel(int level);
+    virtual void setCompressionProbe(bool enable);
+
+private:
+    DISABLE_COPY(XmlConfV6);
+
+    std::unique_ptr<XmlConf::Private> d;
+};
+
+using XmlConfCurrent = XmlConfV6;
 }
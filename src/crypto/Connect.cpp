@@ -21,16 +21,23 @@
 
 #include "Conf.h"
 #include "Container.h"
+#include "Metrics_p.h"
 #include "crypto/OpenSSLHelpers.h"
 #include "util/algorithm.h"
 
 #include <openssl/bio.h>
+#include <openssl/evp.h>
 #include <openssl/ocsp.h>
 #include <openssl/ssl.h>
 
 #include <zlib.h>
 
+#include <array>
+#include <charconv>
 #include <chrono>
+#include <deque>
+#include <mutex>
+#include <optional>
 #include <sstream>
 #include <thread>
 
@@ -56,7 +63,275 @@ using namespace std;
 
 static constexpr size_t MAX_RESPONSE_SIZE = 10 * 1024 * 1024;
 
+namespace {
+/**
+ * Shared TLS contexts, sessions and idle keep-alive connections by host, proxy and trusted
+ * certificates.
+ */
+class Pool
+{
+public:
+    ~Pool() noexcept
+    {
+        for(auto &[key, host]: hosts)
+        {
+            for(const auto &idle: host.idle)
+                BIO_free_all(idle.bio);
+        }
+    }
+
+    static Pool& instance()
+    {
+        static Pool pool;
+        return pool;
+    }
+
+    shared_ptr<SSL_CTX> context(const string &key, const vector<X509Cert> &certs)
+    {
+        lock_guard lock(m);
+        auto &ctx = hosts[key].ctx;
+        if(ctx)
+            return ctx;
+        ctx.reset(SSL_CTX_new(TLS_client_method()), SSL_CTX_free);
+        if(!ctx)
+            return ctx;
+        SSL_CTX_set_mode(ctx.get(), SSL_MODE_AUTO_RETRY);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+        /* Make OpenSSL 3.0.0 behave like 1.1.1 */
+        auto options = SSL_CTX_get_options(ctx.get());
+        options |= SSL_OP_IGNORE_UNEXPECTED_EOF;
+        SSL_CTX_set_options(ctx.get(), options);
+#endif
+        SSL_CTX_set_quiet_shutdown(ctx.get(), 1);
+        SSL_CTX_set_session_cache_mode(ctx.get(), SSL_SESS_CACHE_CLIENT);
+        if(!certs.empty())
+        {
+            SSL_CTX_set_verify(ctx.get(), SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, nullptr);
+            X509_STORE *store = SSL_CTX_get_cert_store(ctx.get());
+            X509_STORE_set_flags(store, X509_V_FLAG_TRUSTED_FIRST | X509_V_FLAG_PARTIAL_CHAIN);
+            for(const X509Cert &cert: certs)
+            {
+                if(cert.handle())
+                    X509_STORE_add_cert(store, cert.handle());
+            }
+        }
+        return ctx;
+    }
+
+    shared_ptr<SSL_SESSION> session(const string &key)
+    {
+        lock_guard lock(m);
+        return hosts[key].session;
+    }
+
+    void setSession(const string &key, SSL_SESSION *session)
+    {
+        if(!session)
+            return;
+        lock_guard lock(m);
+        hosts[key].session.reset(session, SSL_SESSION_free);
+    }
+
+    BIO* take(const string &key)
+    {
+        auto timeout = chrono::seconds(CONF(connectionIdleTimeout));
+        lock_guard lock(m);
+        auto &idle = hosts[key].idle;
+        while(!idle.empty())
+        {
+            Idle i = idle.back();
+            idle.pop_back();
+            if(chrono::steady_clock::now() - i.since < timeout)
+                return i.bio;
+            BIO_free_all(i.bio);
+        }
+        return nullptr;
+    }
+
+    void release(const string &key, BIO *bio)
+    {
+        auto size = size_t(max(0, CONF(connectionPoolSize)));
+        lock_guard lock(m);
+        auto &idle = hosts[key].idle;
+        idle.push_back({bio, chrono::steady_clock::now()});
+        for(; idle.size() > size; idle.pop_front())
+            BIO_free_all(idle.front().bio);
+    }
+
+private:
+    struct Idle {
+        BIO *bio;
+        chrono::steady_clock::time_point since;
+    };
+    struct Host {
+        shared_ptr<SSL_CTX> ctx;
+        shared_ptr<SSL_SESSION> session;
+        deque<Idle> idle;
+    };
+    mutex m;
+    map<string,Host> hosts;
+};
+
+/**
+ * Incremental HTTP message body decoder, removes chunked transfer coding and inflates compressed
+ * content as data arrives.
+ */
+class Body
+{
+public:
+    Body(const Connect::Result &r, bool head, Connect::Sink &&out)
+        : sink(std::move(out))
+    {
+        string_view status = r.result.size() > 12 ? string_view(r.result).substr(9, 3) : string_view();
+        if(head || status.starts_with('1') || status == "204" || status == "304")
+            return;
+        done = false;
+        if(auto it = r.headers.find("transfer-encoding");
+            it != r.headers.cend() && to_lower(it->second).find("chunked") != string::npos)
+            framing = Chunked;
+        else if(it = r.headers.find("content-length"); it != r.headers.cend())
+        {
+            framing = Length;
+            left = strtoull(it->second.c_str(), nullptr, 10);
+            done = left == 0;
+        }
+        else
+            framing = Close;
+
+        const auto it = r.headers.find("content-encoding");
+        if(it == r.headers.cend())
+            return;
+        int result = Z_OK;
+        if(it->second == "gzip")
+            result = inflateInit2(&z, 16 + MAX_WBITS);
+        else if(it->second == "deflate")
+            result = inflateInit2(&z, -MAX_WBITS);
+        else
+        {
+            WARN("Unsuported Content-Encoding: %s", it->second.c_str());
+            return;
+        }
+        if(result != Z_OK)
+            WARN("Failed to uncompress content Content-Encoding: %s", it->second.c_str());
+        inflating = result == Z_OK;
+    }
+
+    ~Body() noexcept
+    {
+        if(inflating)
+            inflateEnd(&z);
+    }
+
+    bool complete() const noexcept
+    {
+        return done;
+    }
+
+    /**
+     * Connection was closed by server, completes body that is delimited by closing the connection.
+     */
+    void close() noexcept
+    {
+        if(framing == Close)
+            done = true;
+    }
+
+    bool delimited() const noexcept
+    {
+        return framing != Close;
+    }
+
+    void operator()(string_view data)
+    {
+        switch(framing)
+        {
+        case None: return;
+        case Close: return decode(data);
+        case Length:
+            data = data.substr(0, size_t(min<uint64_t>(left, data.size())));
+            left -= data.size();
+            done = left == 0;
+            return decode(data);
+        case Chunked: break;
+        }
+
+        pending.append(data);
+        string_view buf = pending;
+        while(!done)
+        {
+            if(left > 0)
+            {
+                if(buf.empty())
+                    break;
+                string_view chunk = buf.substr(0, size_t(min<uint64_t>(left, buf.size())));
+                decode(chunk);
+                buf.remove_prefix(chunk.size());
+                left -= chunk.size();
+                continue;
+            }
+            size_t line = buf.find("\r\n");
+            if(line == string_view::npos)
+                break;
+            string_view field = buf.substr(0, line);
+            buf.remove_prefix(line + 2);
+            switch(state)
+            {
+            case Size:
+                if(from_chars(field.data(), field.data() + field.size(), left, 16).ec != errc())
+                    THROW_NETWORKEXCEPTION("Invalid HTTP chunk size")
+                state = left > 0 ? Data : Trailer;
+                break;
+            case Data:
+                // CRLF after chunk data
+                state = Size;
+                break;
+            case Trailer:
+                done = field.empty();
+                break;
+            }
+        }
+        pending.erase(0, pending.size() - buf.size());
+    }
+
+private:
+    void decode(string_view data)
+    {
+        if(!inflating)
+            return write(data);
+        z.next_in = (Bytef*)data.data();
+        z.avail_in = uInt(data.size());
+        array<char,16384> out{};
+        do {
+            z.next_out = (Bytef*)out.data();
+            z.avail_out = uInt(out.size());
+            int result = inflate(&z, Z_NO_FLUSH);
+            if(result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+                THROW_NETWORKEXCEPTION("Failed to decompress HTTP content")
+            write({out.data(), out.size() - z.avail_out});
+            if(result != Z_OK)
+                break;
+        } while(z.avail_in > 0 || z.avail_out == 0);
+    }
+
+    void write(string_view data)
+    {
+        if(data.empty())
+            return;
+        if((size += data.size()) > MAX_RESPONSE_SIZE)
+            THROW_NETWORKEXCEPTION("HTTP decompressed response exceeds maximum allowed size of %zu bytes", MAX_RESPONSE_SIZE)
+        sink(data);
+    }
 
+    Connect::Sink sink;
+    z_stream z {};
+    enum { None, Length, Chunked, Close } framing = None;
+    enum { Size, Data, Trailer } state = Size;
+    string pending;
+    uint64_t left = 0;
+    size_t size = 0;
+    bool done = true, inflating = false;
+};
+}
 
 Connect::Connect(const string &_url, string _method, int _timeout, const vector<X509Cert> &certs, const string &userAgentData, const string &version)
     : method(std::move(_method))
@@ -64,16 +339,17 @@ Connect::Connect(const string &_url, string _method, int _timeout, const vector<
 {
     DEBUG("Connecting to URL: %s", _url.c_str());
     char *_host = nullptr, *_port = nullptr, *_path = nullptr;
-    int usessl = 0;
-    if(!OCSP_parse_url(_url.c_str(), &_host, &_port, &_path, &usessl))
+    int _usessl = 0;
+    if(!OCSP_parse_url(_url.c_str(), &_host, &_port, &_path, &_usessl))
     {
         OpenSSLException e(EXCEPTION_PARAMS("Incorrect URL provided: '%s'.", _url.c_str()));
         e.setCode(Exception::InvalidUrl);
         throw e;
     }
 
-    string host = _host ? _host : "";
-    string port = _port ? _port : "80";
+    host = _host ? _host : "";
+    port = _port ? _port : "80";
+    usessl = _usessl > 0;
     string path = _path ? _path : "/";
     string url = (_path && char_traits<char>::length(_path) == 1 && _path[0] == '/' && _url[_url.size() - 1] != '/') ? _url + '/' : _url;
     OPENSSL_free(_host);
@@ -84,93 +360,117 @@ Connect::Connect(const string &_url, string _method, int _timeout, const vector<
             baseurl = url.substr(0, pos);
     }
 
-    string hostname = host + ':' + port;
+    hostname = host + ':' + port;
     Conf *c = Conf::instance();
     if(!c->proxyHost().empty() && !c->proxyPort().empty())
     {
         hostname = c->proxyHost() + ":" + c->proxyPort();
-        if(usessl == 0 || (CONF(proxyForceSSL)))
+        if(!usessl || (CONF(proxyForceSSL)))
             path = std::move(url);
     }
 
-    DEBUG("Connecting to Host: %s timeout: %i", hostname.c_str(), _timeout);
+    key = hostname + '|' + host + ':' + port + (usessl ? "|tls" : "") + (timeout > 0 ? "|nbio" : "");
+    for(const X509Cert &cert: certs)
+    {
+        array<unsigned char,EVP_MAX_MD_SIZE> digest{};
+        unsigned int size = 0;
+        if(cert.handle() && X509_digest(cert.handle(), EVP_sha256(), digest.data(), &size) == 1)
+            key.append(1, '|').append((const char*)digest.data(), size);
+    }
+    if(usessl)
+    {
+        ssl = Pool::instance().context(key, certs);
+        if(!ssl)
+            THROW_NETWORKEXCEPTION("Failed to create ssl connection with host: '%s'", hostname.c_str())
+    }
+
+    http11 = version == "1.1";
+    keepAlive = CONF(connectionPoolSize) > 0;
+    if(keepAlive && (d = Pool::instance().take(key)))
+    {
+        DEBUG("Reusing connection to Host: %s", hostname.c_str());
+        reused = true;
+    }
+    else
+    {
+        try {
+            connect();
+        } catch(...) {
+            // Connection failure is recorded as failed request
+            MetricsPrivate::Request failed(host);
+            throw;
+        }
+    }
+
+    request = Log::format("%s %s HTTP/%s\r\n", method.c_str(), path.c_str(), version.c_str());
+    addHeader("Connection", keepAlive ? "keep-alive" : "close");
+    if(port == "80" || port == "443")
+        addHeader("Host", host);
+    else
+        addHeader("Host", host + ':' + port);
+    if(const auto &agent = userAgentData.empty() ? userAgent() : userAgentData; !agent.empty())
+        addHeader("User-Agent", "LIB libdigidocpp/" VERSION_STR " (" TARGET_ARCH ") APP " + agent);
+    if(!usessl)
+        sendProxyAuth();
+}
+
+/**
+ * Opens new connection, establishes proxy tunnel and TLS session when needed. TLS session of
+ * previous connection to same host is resumed.
+ */
+void Connect::connect()
+{
+    DEBUG("Connecting to Host: %s timeout: %i", hostname.c_str(), timeout);
     d = BIO_new_connect(hostname.c_str());
     if(!d)
         THROW_NETWORKEXCEPTION("Failed to create connection with host: '%s'", hostname.c_str())
 
-    BIO_set_nbio(d, _timeout > 0);
+    BIO_set_nbio(d, timeout > 0);
     auto start = chrono::high_resolution_clock::now();
     if(timeout > 0 && BIO_do_connect_retry(d, timeout, -1) < 1)
         THROW_NETWORKEXCEPTION("Failed to create connection with host timeout: '%s'", hostname.c_str())
     if(timeout == 0 && BIO_do_connect(d) < 1)
         THROW_NETWORKEXCEPTION("Failed to create connection with host: '%s'", hostname.c_str())
 
-    if(usessl > 0)
+    if(!usessl)
+        return;
+
+    if(Conf *c = Conf::instance(); !c->proxyHost().empty() && (CONF(proxyTunnelSSL)))
     {
-        if(!c->proxyHost().empty() && (CONF(proxyTunnelSSL)))
-        {
-            BIO_printf(d, "CONNECT %s:%s HTTP/1.0\r\n", host.c_str(), port.c_str());
-            addHeader("Host", host + ':' + port);
-            sendProxyAuth();
-            doProxyConnect = true;
-            Result r = exec();
-            if(!r.isOK() || (r.result.find("established") == string::npos && r.result.find("ok") == string::npos))
-                THROW_NETWORKEXCEPTION("Failed to create proxy connection with host: '%s'", hostname.c_str())
-            doProxyConnect = false;
-        }
+        string saved = std::move(request);
+        request = Log::format("CONNECT %s:%s HTTP/1.0\r\n", host.c_str(), port.c_str());
+        addHeader("Host", host + ':' + port);
+        sendProxyAuth();
+        doProxyConnect = true;
+        Result r = exec();
+        if(!r.isOK() || (r.result.find("established") == string::npos && r.result.find("ok") == string::npos))
+            THROW_NETWORKEXCEPTION("Failed to create proxy connection with host: '%s'", hostname.c_str())
+        doProxyConnect = false;
+        request = std::move(saved);
+    }
 
-        ssl.reset(SSL_CTX_new(TLS_client_method()), SSL_CTX_free);
-        if(!ssl)
-            THROW_NETWORKEXCEPTION("Failed to create ssl connection with host: '%s'", hostname.c_str())
-        SSL_CTX_set_mode(ssl.get(), SSL_MODE_AUTO_RETRY);
-#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
-        /* Make OpenSSL 3.0.0 behave like 1.1.1 */
-        auto options = SSL_CTX_get_options(ssl.get());
-        options |= SSL_OP_IGNORE_UNEXPECTED_EOF;
-        SSL_CTX_set_options(ssl.get(), options);
-#endif
-        SSL_CTX_set_quiet_shutdown(ssl.get(), 1);
-        if(!certs.empty())
-        {
-            SSL_CTX_set_verify(ssl.get(), SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, nullptr);
-            X509_STORE *store = SSL_CTX_get_cert_store(ssl.get());
-            X509_STORE_set_flags(store, X509_V_FLAG_TRUSTED_FIRST | X509_V_FLAG_PARTIAL_CHAIN);
-            for(const X509Cert &cert: certs)
-            {
-                if(cert.handle())
-                    X509_STORE_add_cert(store, cert.handle());
-            }
-        }
-        BIO *sbio = BIO_new_ssl(ssl.get(), 1);
-        if(!sbio)
+    BIO *sbio = BIO_new_ssl(ssl.get(), 1);
+    if(!sbio)
+        THROW_NETWORKEXCEPTION("Failed to create ssl connection with host: '%s'", hostname.c_str())
+    if(SSL *s {}; BIO_get_ssl(sbio, &s) == 1 && s)
+    {
+        SSL_set1_host(s, host.c_str());
+        SSL_set_tlsext_host_name(s, host.c_str());
+        if(auto session = Pool::instance().session(key))
+            SSL_set_session(s, session.get());
+    }
+    d = BIO_push(sbio, d);
+    while(BIO_do_handshake(d) != 1)
+    {
+        if(timeout == 0)
             THROW_NETWORKEXCEPTION("Failed to create ssl connection with host: '%s'", hostname.c_str())
-        if(SSL *ssl {}; BIO_get_ssl(sbio, &ssl) == 1 && ssl)
-        {
-            SSL_set1_host(ssl, host.c_str());
-            SSL_set_tlsext_host_name(ssl, host.c_str());
-        }
-        d = BIO_push(sbio, d);
-        while(BIO_do_handshake(d) != 1)
-        {
-            if(_timeout == 0)
-                THROW_NETWORKEXCEPTION("Failed to create ssl connection with host: '%s'", hostname.c_str())
-            auto end = chrono::high_resolution_clock::now();
-            if(chrono::duration_cast<chrono::seconds>(end - start).count() >= _timeout)
-                THROW_NETWORKEXCEPTION("Failed to create ssl connection with host timeout: '%s'", hostname.c_str())
-            this_thread::sleep_for(chrono::milliseconds(50));
-        }
+        auto end = chrono::high_resolution_clock::now();
+        if(chrono::duration_cast<chrono::seconds>(end - start).count() >= timeout)
+            THROW_NETWORKEXCEPTION("Failed to create ssl connection with host timeout: '%s'", hostname.c_str())
+        this_thread::sleep_for(chrono::milliseconds(50));
     }
-
-    BIO_printf(d, "%s %s HTTP/%s\r\n", method.c_str(), path.c_str(), version.c_str());
-    addHeader("Connection", "close");
-    if(port == "80" || port == "443")
-        addHeader("Host", host);
-    else
-        addHeader("Host", host + ':' + port);
-    if(const auto &agent = userAgentData.empty() ? userAgent() : userAgentData; !agent.empty())
-        addHeader("User-Agent", "LIB libdigidocpp/" VERSION_STR " (" TARGET_ARCH ") APP " + agent);
-    if(usessl == 0)
-        sendProxyAuth();
+    if(SSL *s {}; BIO_get_ssl(d, &s) == 1 && s && SSL_session_reused(s))
+        DEBUG("Resumed TLS session with host: %s", host.c_str());
 }
 
 Connect::~Connect()
@@ -181,95 +481,92 @@ Connect::~Connect()
 
 void Connect::addHeader(string_view key, string_view value)
 {
-    BIO_printf(d, "%.*s: %.*s\r\n", int(key.size()), key.data(), int(value.size()), value.data());
+    request.append(key).append(": ").append(value).append("\r\n");
 }
 
-string Connect::decompress(const string &encoding, const string &data)
+Connect::Result Connect::exec(initializer_list<pair<string_view,string_view>> headers,
+    const unsigned char *data, size_t size)
 {
-    if(data.empty())
-        return data;
-
-    z_stream s {};
-    s.next_in = (Bytef*)data.c_str();
-    s.avail_in = uInt(data.size());
-    int result = Z_OK;
-    if(encoding == "gzip")
-        result = inflateInit2(&s, 16 + MAX_WBITS);
-    else if(encoding == "deflate")
-        result = inflateInit2(&s, -MAX_WBITS);
-    else
-    {
-        WARN("Unsuported Content-Encoding: %s", encoding.c_str());
-        return data;
-    }
-    if(result != Z_OK) {
-        WARN("Failed to uncompress content Content-Encoding: %s", encoding.c_str());
-        return data;
-    }
-
-    string out(2048, 0);
-    do {
-        if(s.total_out >= out.size()) {
-            if(out.size() >= MAX_RESPONSE_SIZE)
-                THROW_NETWORKEXCEPTION("HTTP decompressed response exceeds maximum allowed size of %zu bytes", MAX_RESPONSE_SIZE)
-            out.resize(out.size() * 2);
-        }
-        s.next_out = (Bytef*)&out[s.total_out];
-        s.avail_out = uInt(uLong(out.size()) - s.total_out);
-        switch(inflate(&s, Z_NO_FLUSH))
-        {
-        case Z_OK:
-        case Z_STREAM_END: break;
-        default: THROW_NETWORKEXCEPTION("Failed to decompress HTTP content")
-        }
-    } while(s.avail_out == 0);
-    out.resize(s.total_out);
-    inflateEnd(&s);
-    return out;
+    return exec(headers, {}, data, size);
 }
 
+/**
+ * Sends request and passes decoded response body of successful request to sink as it arrives,
+ * other responses are collected to Result::content.
+ */
 Connect::Result Connect::exec(initializer_list<pair<string_view,string_view>> headers,
-    const unsigned char *data, size_t size)
+    const Sink &sink, const unsigned char *data, size_t size)
 {
     for(const auto &[key, value]: headers)
         addHeader(key, value);
 
     if(size != 0)
-    {
         addHeader("Content-Length", to_string(size));
-        BIO_printf(d, "\r\n");
-        BIO_write(d, data, int(size));
-    }
-    else
-        BIO_printf(d, "\r\n");
+    request += "\r\n";
+    if(size != 0)
+        request.append((const char*)data, size);
 
-    int rc = 0;
-    size_t pos = 0;
-    Result r;
-    r.content.resize(1024);
-    chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
-    do {
-        if(rc > 0) {
-            pos += size_t(rc);
-            if(pos > MAX_RESPONSE_SIZE)
-                THROW_NETWORKEXCEPTION("HTTP response exceeds maximum allowed size of %zu bytes", MAX_RESPONSE_SIZE)
-            if(pos >= r.content.size())
-                r.content.resize(r.content.size() * 2);
+    // Recorded also when request throws
+    optional<MetricsPrivate::Request> metrics(in_place, host);
+    chrono::high_resolution_clock::time_point start;
+    auto isTimeout = [&] {
+        auto end = chrono::high_resolution_clock::now();
+        return timeout > 0 && timeout < chrono::duration_cast<chrono::seconds>(end - start).count();
+    };
+    size_t received = 0;
+    bool closed = false;
+    auto read = [&](string &out) {
+        array<char,16384> buf{};
+        while(!isTimeout())
+        {
+            if(int rc = BIO_read(d, buf.data(), int(buf.size())); rc > 0)
+            {
+                if((received += size_t(rc)) > MAX_RESPONSE_SIZE)
+                    THROW_NETWORKEXCEPTION("HTTP response exceeds maximum allowed size of %zu bytes", MAX_RESPONSE_SIZE)
+                out.append(buf.data(), size_t(rc));
+                return true;
+            }
+            else if(rc == 0 || BIO_should_read(d) != 1)
+            {
+                closed = true;
+                break;
+            }
         }
-        rc = BIO_read(d, &r.content[pos], int(r.content.size() - pos));
-        if(rc == -1 && BIO_should_read(d) != 1)
-            break;
-        if(doProxyConnect && rc > 0) {
-            pos = size_t(rc);
-            break;
+        return false;
+    };
+
+    string head;
+    size_t end = string::npos;
+    while(true)
+    {
+        start = chrono::high_resolution_clock::now();
+        int rc = 0;
+        for(size_t written = 0; written < request.size(); written += size_t(rc))
+        {
+            if((rc = BIO_write(d, &request[written], int(request.size() - written))) > 0)
+                continue;
+            if(BIO_should_retry(d) != 1 || isTimeout())
+                break;
+            rc = 0;
         }
-        auto end = chrono::high_resolution_clock::now();
-        if(timeout > 0 && timeout < chrono::duration_cast<chrono::seconds>(end - start).count())
+
+        received = 0;
+        closed = false;
+        head.clear();
+        while((end = head.find("\r\n\r\n")) == string::npos && read(head));
+
+        // Idle connection was closed by server, send request again on new connection
+        if(!head.empty() || !reused)
             break;
-    } while(rc != 0);
-    r.content.resize(pos);
+        DEBUG("Reused connection to Host: %s was closed", hostname.c_str());
+        reused = false;
+        BIO_free_all(d);
+        d = nullptr;
+        connect();
+    }
 
-    stringstream stream(r.content);
+    Result r;
+    stringstream stream(end == string::npos ? head : head.substr(0, end + 4));
     string line;
     while(getline(stream, line))
     {
@@ -288,36 +585,41 @@ Connect::Result Connect::exec(initializer_list<pair<string_view,string_view>> he
             r.headers[to_lower(line)] = string();
     }
 
-    pos = r.content.find("\r\n\r\n");
-    if(pos != string::npos)
-        r.content.erase(0, pos + 4);
-
-    if(const auto it = r.headers.find("transfer-encoding");
-        it != r.headers.cend() &&
-        it->second.find("chunked") != string::npos) {
-        pos = 0;
-        for(size_t chunkpos = r.content.find("\r\n", pos);
-            chunkpos != string::npos;
-            chunkpos = r.content.find("\r\n", pos))
-        {
-            string chunk = r.content.substr(pos, chunkpos - pos);
-            r.content.erase(pos, chunk.size() + 2);
-            pos += stoul(chunk, nullptr, 16);
-            r.content.erase(pos, 2);
-        }
+    Body body(r, method == "HEAD" || doProxyConnect, sink && r.isOK() ? Sink(sink) : Sink([&r](string_view data) {
+        r.content.append(data);
+    }));
+    if(end != string::npos)
+    {
+        body(string_view(head).substr(end + 4));
+        head.clear();
+        for(string buf; !body.complete() && read(buf); buf.clear())
+            body(buf);
+        if(closed)
+            body.close();
+    }
+    bool complete = end != string::npos && body.complete();
+    if(complete && r.result.size() > 9 && r.result[9] == '2')
+        metrics->succeeded();
+
+    if(SSL *s {}; usessl && BIO_get_ssl(d, &s) == 1 && s)
+        Pool::instance().setSession(key, SSL_get1_session(s));
+    auto connection = r.headers.find("connection");
+    if(string value = connection != r.headers.cend() ? to_lower(connection->second) : string();
+        keepAlive && complete && body.delimited() && !doProxyConnect && value.find("close") == string::npos &&
+        (value.find("keep-alive") != string::npos || (http11 && r.result.starts_with("http/1.1"))))
+    {
+        Pool::instance().release(key, d);
+        d = nullptr;
     }
-
-    if(const auto it = r.headers.find("content-encoding");
-        it != r.headers.cend())
-        r.content = decompress(it->second, r.content);
 
     if(!r.isRedirect() || recursive > 3)
         return r;
+    metrics.reset();
     string &location = r.headers["location"];
     string url = location.find("://") != string::npos ? std::move(location) : baseurl + location;
     Connect c(url, method, timeout);
     c.recursive = recursive + 1;
-    return c.exec(headers);
+    return c.exec(headers, sink);
 }
 
 void Connect::sendProxyAuth()
@@ -326,12 +628,8 @@ void Connect::sendProxyAuth()
     if(c->proxyUser().empty() || c->proxyPass().empty())
         return;
 
-    BIO_printf(d, "Proxy-Authorization: Basic ");
-    auto b64 = make_unique_ptr<BIO_free>(BIO_new(BIO_f_base64()));
-    BIO_set_flags(b64.get(), BIO_FLAGS_BASE64_NO_NL);
-    BIO_push(b64.get(), d);
-    BIO_printf(b64.get(), "%s:%s", c->proxyUser().c_str(), c->proxyPass().c_str());
-    (void)BIO_flush(b64.get());
-    BIO_pop(b64.get());
-    BIO_printf(d, "\r\n");
+    string auth = c->proxyUser() + ':' + c->proxyPass();
+    string b64(((auth.size() + 2) / 3) * 4 + 1, 0);
+    b64.resize(size_t(EVP_EncodeBlock((unsigned char*)b64.data(), (const unsigned char*)auth.data(), int(auth.size()))));
+    addHeader("Proxy-Authorization", "Basic " + b64);
 }
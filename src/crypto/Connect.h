@@ -21,6 +21,7 @@
 
 #include "crypto/X509Cert.h"
 
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
@@ -34,6 +35,8 @@ namespace digidoc {
 class Connect
 {
 public:
+    using Sink = std::function<void (std::string_view data)>;
+
     struct Result {
         std::string result, content;
         std::map<std::string,std::string> headers;
@@ -71,18 +74,21 @@ public:
     }
     Result exec(std::initializer_list<std::pair<std::string_view,std::string_view>> headers = {},
         const unsigned char *data = nullptr, size_t size = 0);
+    Result exec(std::initializer_list<std::pair<std::string_view,std::string_view>> headers,
+        const Sink &sink, const unsigned char *data = nullptr, size_t size = 0);
 
 private:
     DISABLE_COPY(Connect);
 
     void addHeader(std::string_view key, std::string_view value);
+    void connect();
     void sendProxyAuth();
-    static std::string decompress(const std::string &encoding, const std::string &data) ;
 
-    std::string baseurl, method;
+    std::string baseurl, method, host, port, hostname, key, request;
     BIO *d = nullptr;
     std::shared_ptr<SSL_CTX> ssl;
     int timeout;
+    bool usessl = false, http11 = false, keepAlive = false, reused = false;
     bool doProxyConnect = false;
     int recursive = 0;
 };
@@ -20,11 +20,13 @@
 #include "Digest.h"
 
 #include "Conf.h"
+#include "Metrics_p.h"
 #include "crypto/OpenSSLHelpers.h"
 
 #include <openssl/evp.h>
 #include <openssl/x509.h>
 
+#include <algorithm>
 #include <array>
 #include <istream>
 
@@ -210,6 +212,8 @@ void Digest::update(const unsigned char *data, size_t length) const
 {
     if(!data)
         THROW("Can not update digest value from NULL pointer.");
+    MetricsPrivate::Timer timer(MetricsPrivate::DigestTime);
+    MetricsPrivate::add(MetricsPrivate::DigestBytes, length);
     if(EVP_DigestUpdate(d.get(), data, length) != 1)
         THROW_OPENSSLEXCEPTION("Failed to update %s digest value", uri().c_str());
 }
@@ -254,3 +258,64 @@ vector<unsigned char> Digest::result(const vector<unsigned char> &data) const
     update(data.data(), data.size());
     return result();
 }
+
+
+/**
+ * Initializes digest calculators. Duplicate methods are calculated once.
+ *
+ * @param uris digest method URIs.
+ * @throws Exception throws exception if any digest calculator initialization failed.
+ */
+MultiDigest::MultiDigest(const vector<string> &uris)
+{
+    d.reserve(uris.size());
+    for(const string &uri: uris)
+    {
+        if(none_of(d.cbegin(), d.cend(), [&uri](const auto &i) { return i.first == uri; }))
+            d.emplace_back(uri, Digest(uri));
+    }
+}
+
+/**
+ * Add data for all digest calculations.
+ *
+ * @param data data to add for digest calculation.
+ * @param length length of the data.
+ * @throws Exception throws exception if update failed.
+ */
+void MultiDigest::update(const unsigned char *data, size_t length) const
+{
+    for(const auto &[uri, digest]: d)
+        digest.update(data, length);
+}
+
+/**
+ * Add data for all digest calculations. Each block is read from the stream once.
+ *
+ * @param is stream to add for digest calculation.
+ * @throws Exception throws exception if update failed.
+ */
+void MultiDigest::update(istream &is) const
+{
+    array<unsigned char, 10240> buf{};
+    while(is)
+    {
+        is.read((char*)buf.data(), streamsize(buf.size()));
+        if(is.gcount() > 0)
+            update(buf.data(), size_t(is.gcount()));
+    }
+}
+
+/**
+ * Calculate message digests. SHA contexts will be invalid after this call.
+ *
+ * @return returns the calculated digests keyed by method URI given to constructor.
+ * @throws Exception throws exception if update failed.
+ */
+map<string,vector<unsigned char>> MultiDigest::result() const
+{
+    map<string,vector<unsigned char>> result;
+    for(const auto &[uri, digest]: d)
+        result.emplace(uri, digest.result());
+    return result;
+}
@@ -23,6 +23,7 @@
 
 #include "util/memory.h"
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -92,4 +93,20 @@ namespace digidoc
           unique_free_t<EVP_MD_CTX> d;
     };
 
+    /**
+     * Calculates digests of multiple methods over the same data in one pass.
+     */
+    class MultiDigest
+    {
+      public:
+          MultiDigest(const std::vector<std::string> &uris);
+          void update(const unsigned char *data, size_t length) const;
+          void update(std::istream &is) const;
+          std::map<std::string,std::vector<unsigned char>> result() const;
+          bool empty() const { return d.empty(); }
+
+      private:
+          std::vector<std::pair<std::string,Digest>> d;
+    };
+
 }
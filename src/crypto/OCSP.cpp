@@ -21,14 +21,20 @@
 
 #include "Conf.h"
 #include "Container.h"
+#include "Metrics_p.h"
 #include "crypto/Connect.h"
 #include "crypto/OpenSSLHelpers.h"
 #include "crypto/X509CertStore.h"
 #include "util/DateTime.h"
+#include "util/File.h"
 #include "util/log.h"
 
 #include <algorithm>
 #include <array>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
 
 #include <openssl/ocsp.h>
 #include <openssl/pem.h>
@@ -36,12 +42,117 @@
 #include <openssl/sha.h>
 
 using namespace digidoc;
+using namespace digidoc::util;
 using namespace std;
 
+namespace {
+/**
+ * OCSP responses by CertID and responder URL, kept in memory and optionally in directory
+ * to share them between processes. Lock guards only in-memory responses, files are replaced
+ * atomically. Cached response is reused only when it is still valid and
+ * verifies with current trust store, otherwise new response is requested.
+ */
+class OCSPCache
+{
+public:
+    static string key(const string &url, OCSP_CERTID *certId)
+    {
+        vector<unsigned char> data = i2d<i2d_OCSP_CERTID>(certId);
+        data.insert(data.begin(), url.cbegin(), url.cend());
+        array<unsigned char,SHA256_DIGEST_LENGTH> digest{};
+        SHA256(data.data(), data.size(), digest.data());
+        string result;
+        for(unsigned char c: digest)
+            result += Log::format("%02x", c);
+        return result;
+    }
+
+    static vector<unsigned char> find(const string &key)
+    {
+        {
+            lock_guard lock(m);
+            if(auto i = responses.find(key); i != responses.cend())
+                return i->second;
+        }
+        string path = CONF(OCSPCachePath);
+        if(path.empty())
+            return {};
+        ifstream is(File::encodeName(File::path(path, key + ".der")), ifstream::binary);
+        return {istreambuf_iterator<char>(is), istreambuf_iterator<char>()};
+    }
+
+    static void insert(const string &key, vector<unsigned char> &&der)
+    {
+        // Each writer uses own temporary file, directory may be shared between processes
+        if(string path = CONF(OCSPCachePath); !path.empty())
+        {
+            string file = File::path(path, key + ".der");
+            string tmp = File::tempPath(file);
+            error_code ec;
+            filesystem::create_directories(File::encodeName(path), ec);
+            bool stored = false;
+            if(ofstream os(File::encodeName(tmp), ofstream::binary|ofstream::trunc);
+                os.write((const char*)der.data(), streamsize(der.size())))
+            {
+                os.close();
+                filesystem::rename(File::encodeName(tmp), File::encodeName(file), ec);
+                stored = !ec;
+            }
+            if(!stored)
+            {
+                filesystem::remove(File::encodeName(tmp), ec);
+                WARN("Failed to store OCSP response %s", file.c_str());
+            }
+        }
+        lock_guard lock(m);
+        if(responses.size() >= MAX_SIZE)
+            responses.clear();
+        responses.insert_or_assign(key, std::move(der));
+    }
+
+private:
+    static constexpr size_t MAX_SIZE = 1024;
+    static mutex m;
+    static map<string,vector<unsigned char>> responses;
+};
+
+mutex OCSPCache::m;
+map<string,vector<unsigned char>> OCSPCache::responses;
+}
+
+/**
+ * Checks that response contains status of certificate, is in valid time slot and was produced
+ * at or after given time.
+ */
+static void checkResponse(OCSP_BASICRESP *basic, OCSP_CERTID *certId, time_t notBefore)
+{
+    ASN1_GENERALIZEDTIME *thisUpdate {}, *nextUpdate {};
+    if(OCSP_resp_find_status(basic, certId, nullptr, nullptr, nullptr, &thisUpdate, &nextUpdate) != 1)
+        THROW("Failed to find CERT_ID from OCSP response.");
+
+    if(!OCSP_check_validity(thisUpdate, nextUpdate, 15*60, 2*60))
+    {
+        Exception e(EXCEPTION_PARAMS("OCSP response not in valid time slot."));
+        e.setCode(Exception::OCSPTimeSlot);
+        throw e;
+    }
+
+    if(notBefore > 0 && ASN1_TIME_cmp_time_t(OCSP_resp_get0_produced_at(basic), notBefore) < 0)
+        THROW("OCSP response is produced before requested time.");
+}
+
 /**
  * Initialize OCSP certificate validator.
+ *
+ * When OCSP cache is enabled, valid cached response for same certificate and responder
+ * is returned instead of making new request. Cached response that does not verify,
+ * eg. responder is no longer trusted or response was tampered in cache directory,
+ * is replaced with new response.
+ *
+ * @param notBefore cached response is reused only when it is produced at or after that time,
+ * e.g. signature time-stamp time.
  */
-OCSP::OCSP(const X509Cert &cert, const X509Cert &issuer, const std::string &userAgent)
+OCSP::OCSP(const X509Cert &cert, const X509Cert &issuer, const std::string &userAgent, tm notBefore)
     : resp(nullptr, OCSP_RESPONSE_free)
     , basic(nullptr, OCSP_BASICRESP_free)
 {
@@ -78,13 +189,36 @@ OCSP::OCSP(const X509Cert &cert, const X509Cert &issuer, const std::string &user
     if(!OCSP_request_add0_id(req.get(), certId))
         THROW_OPENSSLEXCEPTION("Failed to add certificate ID to OCSP request.");
 
+    time_t notBefore_t = util::date::is_empty(notBefore) ? 0 : util::date::mkgmtime(notBefore);
+    string key;
+    if(CONF(OCSPCache))
+    {
+        key = OCSPCache::key(url, certId);
+        if(OCSP cached(OCSPCache::find(key)); cached.basic && OCSP_response_status(cached.resp.get()) == OCSP_RESPONSE_STATUS_SUCCESSFUL)
+        {
+            try {
+                checkResponse(cached.basic.get(), certId, notBefore_t);
+                cached.verifyResponse(cert);
+                DEBUG("OCSP cached response producedAt: %s", util::date::to_string(cached.producedAt()).c_str());
+                MetricsPrivate::cache(MetricsPrivate::OCSPResponseCache, true);
+                *this = std::move(cached);
+                return;
+            } catch(const Exception &e) {
+                DEBUG("OCSP cached response is not usable: %s", e.msg().c_str());
+            }
+        }
+    }
+
     if(!OCSP_request_add1_nonce(req.get(), nullptr, 32)) // rfc8954: SIZE(1..32)
         THROW_OPENSSLEXCEPTION("Failed to add NONCE to OCSP request.");
 
+    if(!key.empty())
+        MetricsPrivate::cache(MetricsPrivate::OCSPResponseCache, false);
+    MetricsPrivate::add(MetricsPrivate::OCSPRequests, 1);
+
     Connect::Result result = Connect(url, "POST", 0, {}, userAgent, "1.0").exec({
         {"Content-Type", "application/ocsp-request"},
         {"Accept", "application/ocsp-response"},
-        {"Connection", "Close"},
         {"Cache-Control", "no-cache"}
     }, i2d<i2d_OCSP_REQUEST>(req));
 
@@ -117,17 +251,11 @@ OCSP::OCSP(const X509Cert &cert, const X509Cert &issuer, const std::string &user
     if(OCSP_check_nonce(req.get(), basic.get()) <= 0)
         THROW("Incorrect NONCE field value.");
 
-    ASN1_GENERALIZEDTIME *thisUpdate {}, *nextUpdate {};
-    if(OCSP_resp_find_status(basic.get(), certId, nullptr, nullptr, nullptr, &thisUpdate, &nextUpdate) != 1)
-        THROW("Failed to find CERT_ID from OCSP response.");
-
     DEBUG("OCSP producedAt: %s", util::date::to_string(producedAt()).c_str());
-    if(!OCSP_check_validity(thisUpdate, nextUpdate, 15*60, 2*60))
-    {
-        Exception e(EXCEPTION_PARAMS("OCSP response not in valid time slot."));
-        e.setCode(Exception::OCSPTimeSlot);
-        throw e;
-    }
+    checkResponse(basic.get(), certId, 0);
+
+    if(!key.empty())
+        OCSPCache::insert(key, *this);
 }
 
 OCSP::OCSP(const unsigned char *data, size_t size)
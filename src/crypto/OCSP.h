@@ -38,7 +38,7 @@ namespace digidoc
     {
 
       public:
-          OCSP(const X509Cert &cert, const X509Cert &issuer, const std::string &userAgent = {});
+          OCSP(const X509Cert &cert, const X509Cert &issuer, const std::string &userAgent = {}, tm notBefore = {});
           inline OCSP(const std::vector<unsigned char> &data): OCSP(data.data(), data.size()) {}
           OCSP(const unsigned char *data = nullptr, size_t size = 0);
 
@@ -22,6 +22,7 @@
 #include "Conf.h"
 #include "Container.h"
 #include "Exception.h"
+#include "Metrics_p.h"
 #include "crypto/Connect.h"
 #include "crypto/Digest.h"
 #include "crypto/OpenSSLHelpers.h"
@@ -92,10 +93,10 @@ TS::TS(const Digest &digest, const std::string &userAgent)
         RAND_bytes(nonce->data, nonce->length);
     TS_REQ_set_nonce(req.get(), nonce.get());
 
+    MetricsPrivate::add(MetricsPrivate::TSARequests, 1);
     Connect::Result result = Connect(CONF(TSUrl), "POST", 0, CONF(TSCerts), userAgent).exec({
         {"Content-Type", "application/timestamp-query"},
         {"Accept", "application/timestamp-reply"},
-        {"Connection", "Close"},
         {"Cache-Control", "no-cache"}
     }, i2d<i2d_TS_REQ>(req));
 
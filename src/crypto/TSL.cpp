@@ -20,17 +20,27 @@
 #include "crypto/TSL.h"
 
 #include "Conf.h"
+#include "Metrics_p.h"
 #include "XMLDocument.h"
 #include "crypto/Connect.h"
+#include "crypto/Digest.h"
+#include "crypto/OpenSSLHelpers.h"
 #include "util/algorithm.h"
 #include "util/DateTime.h"
 #include "util/File.h"
+#include "util/ThreadPool.h"
+
+#include <openssl/crypto.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
 
 #include <array>
 #include <charconv>
 #include <chrono>
 #include <fstream>
 #include <future>
+#include <span>
 
 using namespace digidoc;
 using namespace digidoc::util;
@@ -84,6 +94,131 @@ constexpr array SERVICES_SUPPORTED {
     "http://uri.etsi.org/TrstSvc/Svctype/TSA/QTST",
 };
 
+constexpr string_view SNAPSHOT_MAGIC {"DDTSL\x03"};
+constexpr size_t SNAPSHOT_KEY_SIZE = 32;
+
+class SnapshotWriter
+{
+public:
+    void operator()(uint64_t value)
+    {
+        for(size_t i = 0; i < 8; ++i, value >>= 8)
+            data.push_back(char(value & 0xFF));
+    }
+    void operator()(string_view value)
+    {
+        operator()(uint64_t(value.size()));
+        data.append(value);
+    }
+    template<class T>
+    void operator()(const vector<T> &list)
+    {
+        operator()(uint64_t(list.size()));
+        for(const T &item: list)
+            operator()(item);
+    }
+    string data;
+};
+
+class SnapshotReader
+{
+public:
+    explicit SnapshotReader(span<const byte> _data): data(_data) {}
+    uint64_t number()
+    {
+        uint64_t value = 0;
+        for(size_t i = 0; i < 8; ++i)
+            value |= uint64_t(take(1)[0]) << (i * 8);
+        return value;
+    }
+    string_view text()
+    {
+        auto size = number();
+        auto bytes = take(size);
+        return {(const char*)bytes.data(), bytes.size()};
+    }
+    vector<string> texts()
+    {
+        vector<string> list(count());
+        for(string &item: list)
+            item = text();
+        return list;
+    }
+    size_t count()
+    {
+        // Every item takes at least 8 bytes, protects from huge allocations on corrupted input
+        auto size = number();
+        if(size > data.size() / 8)
+            THROW("TSL snapshot is corrupted");
+        return size_t(size);
+    }
+    span<const byte> take(uint64_t size)
+    {
+        if(size > data.size())
+            THROW("TSL snapshot is truncated");
+        auto result = data.first(size_t(size));
+        data = data.subspan(size_t(size));
+        return result;
+    }
+    bool empty() const { return data.empty(); }
+
+private:
+    span<const byte> data;
+};
+
+/**
+ * Returns per-user key that authenticates snapshots, key is created on first use. Key is stored
+ * outside of the TSL cache, so that whoever can write to the cache cannot forge a snapshot.
+ *
+ * @return empty when key is not available or is inside the cache, snapshots are not used then
+ */
+static vector<unsigned char> snapshotKey(const string &cache)
+{
+    try {
+        string dir = File::digidocppPath();
+        if(dir.empty())
+            return {};
+        string path = File::path(dir, "tsl.key");
+        error_code ec;
+        auto base = filesystem::weakly_canonical(File::encodeName(cache), ec);
+        auto file = filesystem::weakly_canonical(File::encodeName(path), ec);
+        if(ec || mismatch(base.begin(), base.end(), file.begin(), file.end()).first == base.end())
+            return {};
+        if(auto view = File::map(file); view && view->size() == SNAPSHOT_KEY_SIZE)
+            return {(const unsigned char*)view->data(), (const unsigned char*)view->data() + view->size()};
+
+        vector<unsigned char> key(SNAPSHOT_KEY_SIZE);
+        if(RAND_bytes(key.data(), int(key.size())) != 1)
+            return {};
+        File::createDirectory(dir);
+        string tmp = File::tempPath(path);
+        {
+            ofstream out(File::encodeName(tmp), ofstream::binary|ofstream::trunc);
+            filesystem::permissions(File::encodeName(tmp), filesystem::perms::owner_read|filesystem::perms::owner_write, ec);
+            if(ec || !out.write((const char*)key.data(), streamsize(key.size())) || !out.flush())
+                ec = make_error_code(errc::io_error);
+        }
+        if(!ec)
+            filesystem::rename(File::encodeName(tmp), file, ec);
+        if(!ec)
+            return key;
+        filesystem::remove(File::encodeName(tmp), ec);
+    } catch(const Exception &) {
+        // Snapshots are disabled
+    }
+    return {};
+}
+
+static vector<unsigned char> snapshotMac(const vector<unsigned char> &key, span<const byte> data)
+{
+    vector<unsigned char> mac(EVP_MAX_MD_SIZE);
+    unsigned int size = 0;
+    if(!HMAC(EVP_sha256(), key.data(), int(key.size()), (const unsigned char*)data.data(), data.size(), mac.data(), &size))
+        THROW_OPENSSLEXCEPTION("Failed to calculate TSL snapshot MAC");
+    mac.resize(size);
+    return mac;
+}
+
 }
 
 
@@ -98,8 +233,7 @@ TSL::TSL(string file)
     if(get())
     {
         try {
-            static const XMLSchema schema(File::path(Conf::instance()->xsdPath(), "ts_119612v020201_201601xsd.xsd"));
-            validateSchema(schema);
+            validateSchema(XMLSchema::cached(File::path(Conf::instance()->xsdPath(), "ts_119612v020201_201601xsd.xsd")));
         } catch(const Exception &e) {
             ERR("Failed to validate TSL schema: %s, %s", path.c_str(), e.msg().c_str());
             reset();
@@ -164,18 +298,42 @@ void TSL::debugException(const digidoc::Exception &e)
         debugException(ex);
 }
 
+/**
+ * Downloads list to path. Content is written to temporary file and renamed to path
+ * when download has completed, failed download leaves existing file unchanged.
+ *
+ * @return ETag of the response
+ */
 string TSL::fetch(const string &url, const string &path)
 {
+    string tmp = File::tempPath(path);
     try
     {
-        Connect::Result r = Connect(url, "GET", CONF(TSLTimeOut)).exec({{"Accept-Encoding", "gzip"}});
-        if(!r || r.content.empty())
-            THROW("HTTP status code is not 200 or content is empty");
-        ofstream(File::encodeName(path), fstream::binary|fstream::trunc) << r.content;
+        Connect::Result r;
+        {
+            ofstream file(File::encodeName(tmp), fstream::binary|fstream::trunc);
+            size_t size = 0;
+            MetricsPrivate::add(MetricsPrivate::TSLDownloads, 1);
+            r = Connect(url, "GET", CONF(TSLTimeOut)).exec({{"Accept-Encoding", "gzip"}}, [&](string_view data) {
+                if(!file.write(data.data(), streamsize(data.size())))
+                    THROW("Failed to write file '%s'", tmp.c_str());
+                size += data.size();
+            });
+            if(!r || size == 0)
+                THROW("HTTP status code is not 200 or content is empty");
+            if(!file.flush())
+                THROW("Failed to write file '%s'", tmp.c_str());
+        }
+        error_code ec;
+        filesystem::rename(File::encodeName(tmp), File::encodeName(path), ec);
+        if(ec)
+            THROW("Failed to write file '%s'", path.c_str());
         return r.headers["etag"];
     }
     catch(const Exception &)
     {
+        error_code ec;
+        filesystem::remove(File::encodeName(tmp), ec);
         ERR("TSL %s Failed to download list", url.c_str());
         throw;
     }
@@ -204,35 +362,122 @@ string_view TSL::operatorName() const noexcept
 vector<TSL::Service> TSL::parse(const string &url, const vector<X509Cert> &certs,
     const string &cache, string_view territory)
 {
-    TSL tsl = parseTSL(url, certs, cache, territory);
-    auto pointers = tsl.pointers();
-    if(pointers.empty())
-        return tsl.services();
+    Lists lists;
+    parse(url, certs, cache, territory, {}, lists);
+    vector<Service> list;
+    for(const auto &l: lists)
+        list.insert(list.end(), l->services.cbegin(), l->services.cend());
+    return list;
+}
 
-    vector< future< vector<TSL::Service> > > futures;
-    for(const TSL::Pointer &p: pointers)
+/**
+ * Parses list and lists it points to. Lists that are unchanged since previous parse are reused
+ * without validating them again.
+ *
+ * @param previous lists from previous parse
+ * @param lists parsed lists in order of pointers, failed lists have empty next update
+ */
+void TSL::parse(const string &url, const vector<X509Cert> &certs,
+    const string &cache, string_view territory, const Lists &previous, Lists &lists)
+{
+    string path = File::path(cache, territory);
+    auto start = chrono::steady_clock::now();
+    shared_ptr<const List> list;
+    if(auto i = find_if(previous.cbegin(), previous.cend(), [territory](const auto &l) { return l->territory == territory; });
+        i != previous.cend() && isReusable(**i, listStamp(url, certs, path), path))
+    {
+        DEBUG("TSL %.*s (%llu) is unchanged", STR_VIEW_FMT(territory), (*i)->sequenceNumber);
+        list = *i;
+    }
+    else
+    {
+        TSL tsl = parseTSL(url, certs, cache, territory);
+        auto l = make_shared<List>();
+        l->territory = territory;
+        l->sequenceNumber = tsl.sequenceNumber();
+        l->nextUpdate = tsl.nextUpdate();
+        l->pointers = tsl.pointers();
+        if(l->pointers.empty())
+            l->services = tsl.services();
+        // List may have been updated while parsing
+        l->stamp = listStamp(url, certs, path);
+        list = std::move(l);
+        INFO("TSL %.*s (%llu) loaded in %lld ms", STR_VIEW_FMT(territory), list->sequenceNumber,
+            (long long)chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count());
+    }
+    lists.push_back(list);
+    if(list->pointers.empty())
+        return;
+
+    ThreadPool::Group pool;
+    vector< future<Lists> > futures;
+    for(const TSL::Pointer &p: list->pointers)
     {
         if(!File::fileExists(cache + "/" + p.territory + ".xml"))
             continue;
-        futures.push_back(async(launch::async, [p, cache] noexcept -> vector<TSL::Service> {
+        futures.push_back(pool.submit([&p, &cache, &previous] noexcept -> Lists {
+            Lists result;
             try {
-                return parse(p.location, p.certs, cache, p.territory + ".xml");
+                parse(p.location, p.certs, cache, p.territory + ".xml", previous, result);
             }
             catch(const Exception &e)
             {
                 debugException(e);
                 ERR("TSL %s Failed to validate list", p.territory.c_str());
-                return {};
+                auto failed = make_shared<List>();
+                failed->territory = p.territory + ".xml";
+                result.push_back(std::move(failed));
             }
+            return result;
         }));
     }
-    vector<Service> list;
     for(auto &f: futures)
     {
-        vector<Service> services = f.get();
-        list.insert(list.end(), make_move_iterator(services.begin()), make_move_iterator(services.end()));
+        Lists result = pool.wait(f);
+        lists.insert(lists.end(), make_move_iterator(result.begin()), make_move_iterator(result.end()));
     }
-    return list;
+}
+
+/**
+ * Loads trusted lists. Only lists that changed since previous load are validated again, at
+ * startup previous lists are read from binary snapshot.
+ *
+ * Snapshot is written next to the cached lists and is authenticated with HMAC key that is kept
+ * outside of the cache, snapshot that fails authentication is ignored. Every list in snapshot is
+ * stamped with its URL, signing certificates, digest of cached file and ETag. List is validated
+ * again when stamp does not match, list is expired or, when online digest check is enabled, cached
+ * file was not checked during last day.
+ *
+ * @param previous lists from previous load, snapshot is used when empty.
+ */
+TSL::Lists TSL::load(const string &url, const vector<X509Cert> &certs,
+    const string &cache, string_view territory, const Lists &previous)
+{
+    string path = File::path(cache, string(territory) + ".snapshot");
+    vector<unsigned char> key = snapshotKey(cache);
+    Lists snapshot;
+    if(previous.empty() && !key.empty())
+    {
+        try {
+            snapshot = readSnapshot(path, key);
+        } catch(const Exception &e) {
+            debugException(e);
+            WARN("TSL %.*s snapshot is invalid", STR_VIEW_FMT(territory));
+        }
+    }
+
+    const Lists &base = previous.empty() ? snapshot : previous;
+    Lists lists;
+    parse(url, certs, cache, territory, base, lists);
+    if(lists == base || key.empty())
+        return lists;
+    try {
+        writeSnapshot(path, lists, key);
+    } catch(const Exception &e) {
+        debugException(e);
+        WARN("TSL %.*s failed to write snapshot", STR_VIEW_FMT(territory));
+    }
+    return lists;
 }
 
 TSL TSL::parseTSL(const string &url, const vector<X509Cert> &certs,
@@ -269,10 +514,10 @@ TSL TSL::parseTSL(const string &url, const vector<X509Cert> &certs,
             throw;
     }
 
+    string tmp = File::tempPath(path);
     try {
-        string tmp = path + ".tmp";
         string etag = fetch(url, tmp);
-        TSL tsl = TSL(std::move(tmp));
+        TSL tsl = TSL(tmp);
         tsl.validate(certs);
         valid = std::move(tsl);
 
@@ -285,6 +530,8 @@ TSL TSL::parseTSL(const string &url, const vector<X509Cert> &certs,
 
         DEBUG("TSL %.*s (%llu) signature is valid", STR_VIEW_FMT(territory), valid.sequenceNumber());
     } catch(const Exception &) {
+        error_code ec;
+        filesystem::remove(File::encodeName(tmp), ec);
         ERR("TSL %.*s signature is invalid", STR_VIEW_FMT(territory));
         if(!valid)
             throw;
@@ -616,3 +863,209 @@ bool TSL::validateRemoteDigest(const string &url)
         THROW("TSL %.*s remote digest does not match local. TSL might be outdated", STR_VIEW_FMT(territory()));
     return true;
 }
+
+/**
+ * Calculates stamp of list source: URL, signing certificates, cached file and its ETag.
+ */
+vector<unsigned char> TSL::listStamp(const string &url, const vector<X509Cert> &certs, const string &path)
+{
+    Digest stamp(URI_SHA256);
+    auto update = [&stamp](string_view value) {
+        SnapshotWriter w;
+        w(value);
+        stamp.update((const unsigned char*)w.data.data(), w.data.size());
+    };
+    update(url);
+    for(const X509Cert &cert: certs)
+    {
+        vector<unsigned char> der = cert;
+        update({(const char*)der.data(), der.size()});
+    }
+    for(const string &file: {path, path + ".etag"})
+    {
+        auto view = File::map(File::encodeName(file));
+        update(view ? string_view((const char*)view->data(), view->size()) : string_view());
+    }
+    return stamp.result();
+}
+
+bool TSL::isReusable(const List &list, const vector<unsigned char> &stamp, const string &path)
+{
+    if(list.nextUpdate.empty() || list.stamp != stamp || list.nextUpdate < date::to_string(time(nullptr)))
+        return false;
+    if(!CONF(TSLOnlineDigest))
+        return true;
+    // Cached file is touched after successful online check
+    error_code ec;
+    auto modified = filesystem::last_write_time(File::encodeName(path), ec);
+    return !ec && modified >= chrono::file_clock::now() - 24h;
+}
+
+/**
+ * Reads lists from memory mapped snapshot.
+ *
+ * @param key key that snapshot MAC is calculated with
+ * @throws Exception if snapshot is corrupted or fails authentication
+ */
+TSL::Lists TSL::readSnapshot(const string &path, const vector<unsigned char> &key)
+{
+    auto view = File::map(File::encodeName(path));
+    if(!view)
+        return {};
+    if(view->size() < SHA256_DIGEST_LENGTH)
+        THROW("TSL snapshot is truncated");
+    auto data = view->first(view->size() - SHA256_DIGEST_LENGTH);
+    if(vector<unsigned char> mac = snapshotMac(key, data);
+        mac.size() != SHA256_DIGEST_LENGTH || CRYPTO_memcmp(mac.data(), view->data() + data.size(), mac.size()) != 0)
+        THROW("TSL snapshot authentication failed");
+    SnapshotReader r(data);
+    if(r.text() != SNAPSHOT_MAGIC)
+        return {};
+    auto certs = [&r] {
+        vector<X509Cert> certs(r.count());
+        for(X509Cert &cert: certs)
+        {
+            auto der = r.take(r.number());
+            cert = X509Cert((const unsigned char*)der.data(), der.size());
+        }
+        return certs;
+    };
+    Lists lists(r.count());
+    for(auto &list: lists)
+    {
+        auto l = make_shared<List>();
+        l->territory = r.text();
+        auto stamp = r.text();
+        l->stamp.assign(stamp.cbegin(), stamp.cend());
+        l->sequenceNumber = r.number();
+        l->nextUpdate = r.text();
+        l->pointers.resize(r.count());
+        for(Pointer &p: l->pointers)
+        {
+            p.territory = r.text();
+            p.location = r.text();
+            p.certs = certs();
+        }
+        l->services.resize(r.count());
+        for(Service &s: l->services)
+        {
+            s.type = r.text();
+            s.additional = r.text();
+            s.name = r.text();
+            s.certs = certs();
+            for(size_t i = 0, count = r.count(); i < count; ++i)
+            {
+                string date(r.text());
+                Qualifiers &qualifiers = s.validity[date];
+                if(r.number() == 0)
+                    continue;
+                qualifiers.emplace(r.count());
+                for(Qualifier &q: qualifiers.value())
+                {
+                    q.qualifiers = r.texts();
+                    q.policySet.resize(r.count());
+                    for(auto &policies: q.policySet)
+                        policies = r.texts();
+                    q.keyUsage.resize(r.count());
+                    for(auto &keyUsage: q.keyUsage)
+                    {
+                        for(size_t j = 0, usages = r.count(); j < usages; ++j)
+                        {
+                            auto usage = X509Cert::KeyUsage(r.number());
+                            keyUsage[usage] = r.number() != 0;
+                        }
+                    }
+                    q.assert_ = r.text();
+                }
+            }
+        }
+        list = std::move(l);
+    }
+    if(!r.empty())
+        THROW("TSL snapshot has trailing data");
+    return lists;
+}
+
+/**
+ * Writes lists to snapshot file followed by its MAC. Lists that failed to validate are written
+ * without content and are validated again on next load.
+ *
+ * @param key key that snapshot MAC is calculated with
+ * @throws Exception if writing fails
+ */
+void TSL::writeSnapshot(const string &path, const Lists &lists, const vector<unsigned char> &key)
+{
+    SnapshotWriter w;
+    auto certs = [&w](const vector<X509Cert> &certs) {
+        w(uint64_t(certs.size()));
+        for(const X509Cert &cert: certs)
+        {
+            vector<unsigned char> der = cert;
+            w({(const char*)der.data(), der.size()});
+        }
+    };
+    w(SNAPSHOT_MAGIC);
+    w(uint64_t(lists.size()));
+    for(const auto &l: lists)
+    {
+        w(l->territory);
+        w({(const char*)l->stamp.data(), l->stamp.size()});
+        w(uint64_t(l->sequenceNumber));
+        w(l->nextUpdate);
+        w(uint64_t(l->pointers.size()));
+        for(const Pointer &p: l->pointers)
+        {
+            w(p.territory);
+            w(p.location);
+            certs(p.certs);
+        }
+        w(uint64_t(l->services.size()));
+        for(const Service &s: l->services)
+        {
+            w(s.type);
+            w(s.additional);
+            w(s.name);
+            certs(s.certs);
+            w(uint64_t(s.validity.size()));
+            for(const auto &[date, qualifiers]: s.validity)
+            {
+                w(date);
+                w(uint64_t(qualifiers.has_value()));
+                if(!qualifiers)
+                    continue;
+                w(uint64_t(qualifiers->size()));
+                for(const Qualifier &q: qualifiers.value())
+                {
+                    w(q.qualifiers);
+                    w(q.policySet);
+                    w(uint64_t(q.keyUsage.size()));
+                    for(const auto &keyUsage: q.keyUsage)
+                    {
+                        w(uint64_t(keyUsage.size()));
+                        for(const auto &[usage, set]: keyUsage)
+                        {
+                            w(uint64_t(usage));
+                            w(uint64_t(set));
+                        }
+                    }
+                    w(q.assert_);
+                }
+            }
+        }
+    }
+
+    vector<unsigned char> mac = snapshotMac(key, as_bytes(span(w.data)));
+    w.data.append((const char*)mac.data(), mac.size());
+
+    // Write to temporary file and rename, so that other processes never see partial snapshot
+    string tmp = File::tempPath(path);
+    error_code ec;
+    if(!(ofstream(File::encodeName(tmp), ofstream::binary|ofstream::trunc) << w.data))
+        THROW("Failed to write TSL snapshot %s", tmp.c_str());
+    filesystem::rename(File::encodeName(tmp), File::encodeName(path), ec);
+    if(ec)
+    {
+        filesystem::remove(File::encodeName(tmp), ec);
+        THROW("Failed to write TSL snapshot %s", path.c_str());
+    }
+}
@@ -24,6 +24,7 @@
 #include "XMLDocument.h"
 
 #include <map>
+#include <memory>
 #include <optional>
 
 namespace digidoc
@@ -38,6 +39,14 @@ public:
     using Qualifiers = std::optional<std::vector<Qualifier>>;
     struct Service { std::vector<X509Cert> certs; std::map<std::string,Qualifiers> validity; std::string type, additional, name; };
     struct Pointer { std::string territory, location; std::vector<X509Cert> certs; };
+    struct List {
+        std::string territory, nextUpdate;
+        std::vector<unsigned char> stamp;
+        unsigned long long sequenceNumber {};
+        std::vector<Pointer> pointers;
+        std::vector<Service> services;
+    };
+    using Lists = std::vector<std::shared_ptr<const List>>;
 
     TSL(std::string file = {});
     bool isExpired() const;
@@ -56,8 +65,11 @@ public:
     std::vector<Service> services() const;
 
     static bool activate(std::string_view territory);
+    static std::string fetch(const std::string &url, const std::string &path);
     static std::vector<Service> parse(const std::string &url, const std::vector<X509Cert> &certs,
         const std::string &cache, std::string_view territory);
+    static Lists load(const std::string &url, const std::vector<X509Cert> &certs,
+        const std::string &cache, std::string_view territory, const Lists &previous = {});
 
 private:
     std::vector<std::string> pivotURLs() const;
@@ -66,10 +78,16 @@ private:
     bool validateETag(const std::string &url);
     bool validateRemoteDigest(const std::string &url);
 
-    static std::string fetch(const std::string &url, const std::string &path);
     static void debugException(const Exception &e);
+    static void parse(const std::string &url, const std::vector<X509Cert> &certs,
+        const std::string &cache, std::string_view territory, const Lists &previous, Lists &lists);
     static TSL parseTSL(const std::string &url, const std::vector<X509Cert> &certs,
         const std::string &cache, std::string_view territory) ;
+    static std::vector<unsigned char> listStamp(const std::string &url, const std::vector<X509Cert> &certs,
+        const std::string &path);
+    static bool isReusable(const List &list, const std::vector<unsigned char> &stamp, const std::string &path);
+    static Lists readSnapshot(const std::string &path, const std::vector<unsigned char> &key);
+    static void writeSnapshot(const std::string &path, const Lists &lists, const std::vector<unsigned char> &key);
     static bool parseInfo(XMLNode info, Service &s);
     static std::vector<X509Cert> serviceDigitalIdentity(XMLNode other, std::string_view ctx);
     static std::vector<X509Cert> serviceDigitalIdentities(XMLNode other, std::string_view ctx);
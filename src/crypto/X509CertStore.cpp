@@ -20,6 +20,7 @@
 #include "X509CertStore.h"
 
 #include "Conf.h"
+#include "Signature_p.h"
 #include "crypto/Connect.h"
 #include "crypto/OpenSSLHelpers.h"
 #include "crypto/TSL.h"
@@ -32,6 +33,16 @@
 #include <openssl/ssl.h>
 #include <openssl/x509v3.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
 using namespace digidoc;
 using namespace std;
 
@@ -48,7 +59,164 @@ const X509CertStore::Type X509CertStore::OCSP {
     "http://uri.etsi.org/TrstSvc/Svctype/Certstatus/OCSP/QC",
 };
 
-struct X509CertStore::Private: public vector<TSL::Service> {};
+static string fingerprint(X509 *x509)
+{
+    array<unsigned char,EVP_MAX_MD_SIZE> buf{};
+    unsigned int size = 0;
+    if(X509_digest(x509, EVP_sha256(), buf.data(), &size) != 1)
+        return {};
+    return {(const char*)buf.data(), size};
+}
+
+static string keyId(const ASN1_OCTET_STRING *id)
+{
+    return id ? string((const char*)ASN1_STRING_get0_data(id), size_t(ASN1_STRING_length(id))) : string();
+}
+
+/**
+ * Returns earliest next update of lists that is still in future, lists that are already
+ * expired are refreshed on regular interval.
+ */
+static optional<chrono::system_clock::time_point> nextUpdate(const TSL::Lists &lists)
+{
+    string now = util::date::to_string(time(nullptr));
+    optional<chrono::system_clock::time_point> result;
+    for(const auto &list: lists)
+    {
+        if(list->nextUpdate <= now)
+            continue;
+        tm tm{};
+        if(istringstream is(list->nextUpdate); !(is >> get_time(&tm, "%Y-%m-%dT%H:%M:%S")))
+            continue;
+        auto time = chrono::system_clock::from_time_t(util::date::mkgmtime(tm));
+        if(!result || time < result)
+            result = time;
+    }
+    return result;
+}
+
+/**
+ * Immutable TSL services with lookup index of service certificates. Index refers to services
+ * and certificates by pointer, readers keep snapshot alive while they use its content.
+ * Parsed lists are kept to reuse unchanged lists on next update.
+ */
+struct X509CertStore::Snapshot: public vector<TSL::Service>
+{
+    using Entry = pair<const TSL::Service*,const X509Cert*>;
+    TSL::Lists lists;
+    unordered_multimap<unsigned long,Entry> subjects;
+    unordered_multimap<string,Entry> keys;
+    unordered_multimap<string,Entry> fingerprints;
+
+    Snapshot() = default;
+    explicit Snapshot(TSL::Lists &&_lists)
+        : lists(std::move(_lists))
+    {
+        for(const auto &list: lists)
+            insert(end(), list->services.cbegin(), list->services.cend());
+        for(const TSL::Service &s: *this)
+        {
+            for(const X509Cert &cert: s.certs)
+            {
+                Entry entry{&s, &cert};
+                subjects.emplace(X509_subject_name_hash(cert.handle()), entry);
+                if(string ski = keyId(X509_get0_subject_key_id(cert.handle())); !ski.empty())
+                    keys.emplace(std::move(ski), entry);
+                fingerprints.emplace(fingerprint(cert.handle()), entry);
+            }
+        }
+    }
+
+    /**
+     * Returns certificates of given service type that are listed for certificate or can be its issuer,
+     * ordered as in TSL. Candidates are matched by SKI or subject name only, signature is not checked.
+     */
+    vector<Entry> candidates(X509 *x509, const Type &type, bool listed) const
+    {
+        vector<Entry> result;
+        auto add = [&](auto range) {
+            for(auto i = range.first; i != range.second; ++i)
+            {
+                if(type.contains(i->second.first->type) && !contains(result, i->second))
+                    result.push_back(i->second);
+            }
+        };
+        if(listed)
+            add(fingerprints.equal_range(fingerprint(x509)));
+        if(string aki = keyId(X509_get0_authority_key_id(x509)); !aki.empty())
+            add(keys.equal_range(aki));
+        // Issuer certificate without SKI is not indexed by key, callers check issuer signature
+        add(subjects.equal_range(X509_issuer_name_hash(x509)));
+        sort(result.begin(), result.end(), [](const Entry &a, const Entry &b) {
+            return a.first != b.first ? a.first < b.first : a.second < b.second;
+        });
+        return result;
+    }
+};
+
+struct X509CertStore::Private
+{
+#if __cpp_lib_atomic_shared_ptr
+    atomic<shared_ptr<const Snapshot>> snapshot = make_shared<const Snapshot>();
+    shared_ptr<const Snapshot> load() const { return snapshot.load(); }
+    void publish(shared_ptr<const Snapshot> &&value) { snapshot.store(std::move(value)); }
+#else
+    shared_ptr<const Snapshot> snapshot = make_shared<const Snapshot>();
+    shared_ptr<const Snapshot> load() const { return atomic_load(&snapshot); }
+    void publish(shared_ptr<const Snapshot> &&value) { atomic_store(&snapshot, std::move(value)); }
+#endif
+    // Successful issuer to subject signature checks, independent of TSL content
+    static constexpr size_t MAX_VERIFIED = 4096;
+    unordered_set<string> verified;
+    map<const Type*,unique_free_d<X509_STORE_free>> stores;
+    mutex m, updating;
+    // Background refresh, validation uses last published snapshot meanwhile
+    thread refresher;
+    condition_variable wake;
+    mutex r;
+    bool stopping = false, requested = false;
+    // Number of refreshes taken by refresher
+    uint64_t started = 0;
+    // Activated territories and number of refresh that loads them
+    map<string,uint64_t> pending;
+
+    bool isSignedBy(X509 *x509, const X509Cert &issuer)
+    {
+        string key = fingerprint(issuer.handle()) + fingerprint(x509);
+        if(lock_guard lock(m); verified.contains(key))
+        {
+            ValidationCheck::cacheHit(MetricsPrivate::IssuerSignatureCache);
+            return true;
+        }
+        MetricsPrivate::cache(MetricsPrivate::IssuerSignatureCache, false);
+        auto pub = make_unique_ptr<EVP_PKEY_free>(X509_get_pubkey(issuer.handle()));
+        if(X509_verify(x509, pub.get()) != 1)
+        {
+            ERR_clear_error();
+            return false;
+        }
+        lock_guard lock(m);
+        if(verified.size() >= MAX_VERIFIED)
+            verified.clear();
+        verified.insert(std::move(key));
+        return true;
+    }
+
+    X509_STORE* store(const Type &type)
+    {
+        lock_guard lock(m);
+        auto &store = stores[&type];
+        if(!store)
+        {
+            MetricsPrivate::cache(MetricsPrivate::TrustStoreCache, false);
+            tm tm{};
+            store.reset(createStore(type, tm).release());
+        }
+        else
+            ValidationCheck::cacheHit(MetricsPrivate::TrustStoreCache);
+        return store.get();
+    }
+};
 
 /**
  * X509CertStore constructor.
@@ -60,16 +228,48 @@ X509CertStore::X509CertStore()
 /**
  * Release all certificates.
  */
-X509CertStore::~X509CertStore() noexcept = default;
+X509CertStore::~X509CertStore() noexcept
+{
+    stopRefresh();
+}
 
-void X509CertStore::activate(const X509Cert &cert) const try
+/**
+ * Activates territories of certificate issuer and subject. When background refresh is running,
+ * newly activated lists are loaded by refresh thread and caller does not wait for them,
+ * otherwise lists are loaded immediately.
+ *
+ * @return true when territory of certificate is not yet loaded by refresh thread
+ */
+bool X509CertStore::activate(const X509Cert &cert) const try
 {
-    if(std::max<bool>(TSL::activate(cert.issuerName("C")), TSL::activate(cert.subjectName("C"))))
-        update();
+    string issuer = cert.issuerName("C");
+    string subject = cert.subjectName("C");
+    bool issuerActivated = TSL::activate(issuer);
+    bool subjectActivated = TSL::activate(subject);
+    unique_lock lock(d->r);
+    if(!d->refresher.joinable())
+    {
+        lock.unlock();
+        if(issuerActivated || subjectActivated)
+            update();
+        return false;
+    }
+    if(issuerActivated || subjectActivated)
+    {
+        // Refresh in progress may have started before territory was activated
+        if(issuerActivated)
+            d->pending[issuer] = d->started + 1;
+        if(subjectActivated)
+            d->pending[subject] = d->started + 1;
+        d->requested = true;
+        d->wake.notify_one();
+    }
+    return d->pending.contains(issuer) || d->pending.contains(subject);
 }
 catch(const Exception &e)
 {
-    ERR("Failed to activate TSL: %s", e.msg().c_str()); 
+    ERR("Failed to activate TSL: %s", e.msg().c_str());
+    return false;
 }
 
 /**
@@ -84,7 +284,7 @@ X509CertStore* X509CertStore::instance()
 vector<X509Cert> X509CertStore::certs(const Type &type) const
 {
     vector<X509Cert> certs;
-    for(const TSL::Service &s: *d)
+    for(const TSL::Service &s: *d->load())
     {
         if(type.find(s.type) != type.cend())
             certs.insert(certs.cend(), s.certs.cbegin(), s.certs.cend());
@@ -95,15 +295,11 @@ vector<X509Cert> X509CertStore::certs(const Type &type) const
 X509Cert X509CertStore::findIssuer(const X509Cert &cert, const Type &type) const
 {
     activate(cert);
-    for(const TSL::Service &s: *d)
+    auto snapshot = d->load();
+    for(const auto &[service, issuer]: snapshot->candidates(cert.handle(), type, false))
     {
-        if(type.find(s.type) == type.cend())
-            continue;
-        for(const X509Cert &i: s.certs)
-        {
-            if(X509_check_issued(i.handle(), cert.handle()) == X509_V_OK)
-                return i;
-        }
+        if(X509_check_issued(issuer->handle(), cert.handle()) == X509_V_OK)
+            return *issuer;
     }
     return X509Cert();
 }
@@ -156,22 +352,26 @@ int X509CertStore::validate(int ok, X509_STORE_CTX *ctx)
     auto *type = static_cast<Type*>(X509_STORE_get_ex_data(X509_STORE_CTX_get0_store(ctx), 0));
     X509 *x509 = X509_STORE_CTX_get0_cert(ctx);
     auto current = util::date::to_string(X509_VERIFY_PARAM_get_time(X509_STORE_CTX_get0_param(ctx)));
-    for(const TSL::Service &s: *instance()->d)
+    // verify() pins snapshot for whole verification, as qualifiers are read after verification
+    shared_ptr<const Snapshot> snapshot;
+    const auto *pinned = static_cast<const Snapshot*>(X509_STORE_CTX_get_ex_data(ctx, 1));
+    if(!pinned)
+        pinned = (snapshot = instance()->d->load()).get();
+    const TSL::Service *prev {};
+    for(const auto &[service, issuer]: pinned->candidates(x509, *type, true))
     {
-        if(type->find(s.type) == type->cend()) // correct service type
-            continue;
-        if(none_of(s.certs, [&](const X509Cert &issuer) {
-                if(issuer == x509) // certificate is listed by service
-                    return true;
-                if(X509_check_issued(issuer.handle(), x509) != X509_V_OK) // certificate is issued by service (function checks only issuer name)
-                    return false;
-                auto pub = make_unique_ptr<EVP_PKEY_free>(X509_get_pubkey(issuer.handle()));
-                if(X509_verify(x509, pub.get()) == 1) // certificate is signed by service
-                    return true;
-                ERR_clear_error();
-                return false;
-            })) // certificate is trusted by service
+        if(service == prev) // service is already trusted or checked
             continue;
+        if(!(*issuer == x509)) // certificate is not listed by service
+        {
+            if(X509_check_issued(issuer->handle(), x509) != X509_V_OK) // certificate is issued by service (function checks only issuer name)
+                continue;
+            if(!instance()->d->isSignedBy(x509, *issuer)) // certificate is signed by service
+                continue;
+        }
+        // certificate is trusted by service
+        prev = service;
+        const TSL::Service &s = *service;
         for(auto i = s.validity.crbegin(), end = s.validity.crend(); i != end; ++i)
         {
             if(current < i->first) // Search older status
@@ -185,15 +385,78 @@ int X509CertStore::validate(int ok, X509_STORE_CTX *ctx)
     return ok;
 }
 
+/**
+ * Starts background thread that reloads TSL lists on interval or when earliest list reaches its
+ * next update. Unchanged lists are reused, remote lists are checked by ETag or digest as on
+ * regular update. Validation continues to use last successfully loaded lists during refresh.
+ *
+ * @param interval maximum time between refreshes
+ * @param callBack called after each refresh with exception when refresh failed, may be empty
+ * @param initial load lists immediately, otherwise first refresh is done after interval
+ */
+void X509CertStore::startRefresh(chrono::seconds interval, function<void (const Exception *)> callBack, bool initial) const
+{
+    stopRefresh();
+    lock_guard lock(d->r);
+    d->stopping = false;
+    d->requested = initial;
+    d->refresher = thread([this, interval, callBack = std::move(callBack)] {
+        unique_lock lock(d->r);
+        while(true)
+        {
+            auto deadline = chrono::system_clock::now() + interval;
+            if(auto next = nextUpdate(d->load()->lists); next && next < deadline)
+                deadline = *next;
+            d->wake.wait_until(lock, deadline, [this] { return d->stopping || d->requested; });
+            if(d->stopping)
+                return;
+            d->requested = false;
+            ++d->started;
+            lock.unlock();
+            try {
+                update();
+                if(callBack)
+                    callBack(nullptr);
+            } catch(const Exception &e) {
+                ERR("Failed to refresh TSL lists: %s", e.msg().c_str());
+                if(callBack)
+                    callBack(&e);
+            }
+            lock.lock();
+            erase_if(d->pending, [this](const auto &p) { return p.second <= d->started; });
+        }
+    });
+}
+
+/**
+ * Stops background refresh thread, waits until refresh in progress has completed.
+ */
+void X509CertStore::stopRefresh() const
+{
+    unique_lock lock(d->r);
+    if(!d->refresher.joinable())
+        return;
+    d->stopping = true;
+    d->pending.clear();
+    thread refresher = std::move(d->refresher);
+    lock.unlock();
+    d->wake.notify_one();
+    if(refresher.get_id() != this_thread::get_id())
+        refresher.join();
+    else
+        refresher.detach();
+}
+
 void X509CertStore::update() const
 {
     string url = CONF(TSLUrl);
     string cache = CONF(TSLCache);
     vector<X509Cert> cert = CONF(TSLCerts);
     util::File::createDirectory(cache);
-    vector<TSL::Service> list = TSL::parse(url, cert, cache, util::File::fileName(url));
-    d->swap(list);
-    INFO("Loaded %zu certificates into TSL certificate store.", d->size());
+    lock_guard lock(d->updating);
+    auto snapshot = make_shared<const Snapshot>(TSL::load(url, cert, cache, util::File::fileName(url), d->load()->lists));
+    INFO("Loaded %zu certificates into TSL certificate store.", snapshot->size());
+    d->publish(std::move(snapshot));
 }
 
 /**
@@ -202,19 +465,23 @@ void X509CertStore::update() const
  */
 bool X509CertStore::verify(const X509Cert &cert, bool noqscd, tm validation_time) const
 {
-    activate(cert);
+    bool loading = activate(cert);
     if(util::date::is_empty(validation_time))
         ASN1_TIME_to_tm(X509_get0_notBefore(cert.handle()), &validation_time);
-    auto store = createStore(X509CertStore::CA, validation_time);
     auto csc = make_unique_ptr<X509_STORE_CTX_free>(X509_STORE_CTX_new());
-    if(!X509_STORE_CTX_init(csc.get(), store.get(), cert.handle(), nullptr))
+    if(!X509_STORE_CTX_init(csc.get(), d->store(X509CertStore::CA), cert.handle(), nullptr))
         THROW_OPENSSLEXCEPTION("Failed to init X509_STORE_CTX");
+    X509_STORE_CTX_set_time(csc.get(), 0, util::date::mkgmtime(validation_time));
+    auto snapshot = d->load();
+    X509_STORE_CTX_set_ex_data(csc.get(), 1, const_cast<Snapshot*>(snapshot.get()));
     if(X509_verify_cert(csc.get()) <= 0)
     {
         int err = X509_STORE_CTX_get_error(csc.get());
         OpenSSLException e(EXCEPTION_PARAMS("%s", X509_verify_cert_error_string(err)));
         if(err == X509_V_ERR_UNABLE_TO_GET_ISSUER_CERT_LOCALLY)
             e.setCode(Exception::CertificateIssuerMissing);
+        if(loading)
+            e.addCause(Exception(EXCEPTION_PARAMS("Trust list of certificate territory is not loaded yet, validate again after TSL refresh")));
         throw e;
     }
 
@@ -23,6 +23,8 @@
 
 #include "util/memory.h"
 
+#include <chrono>
+#include <functional>
 #include <set>
 #include <string>
 #include <vector>
@@ -32,6 +34,7 @@ using X509_STORE_CTX = struct x509_store_ctx_st;
 
 namespace digidoc
 {
+    class Exception;
     class X509Cert;
     /**
      * X.509 certificate store interface.
@@ -44,11 +47,13 @@ namespace digidoc
 
         static X509CertStore* instance();
 
-        void activate(const X509Cert &cert) const;
+        bool activate(const X509Cert &cert) const;
         std::vector<X509Cert> certs(const Type &type) const;
         X509Cert findIssuer(const X509Cert &cert, const Type &type) const;
         static X509Cert issuerFromAIA(const X509Cert &cert);
         static unique_free_t<X509_STORE> createStore(const Type &type, tm &tm);
+        void startRefresh(std::chrono::seconds interval, std::function<void (const Exception *)> callBack, bool initial) const;
+        void stopRefresh() const;
         void update() const;
         bool verify(const X509Cert &cert, bool noqscd, tm validation_time = {}) const;
 
@@ -58,6 +63,7 @@ namespace digidoc
         DISABLE_COPY(X509CertStore);
 
         static int validate(int ok, X509_STORE_CTX *ctx);
+        struct Snapshot;
         struct Private;
         std::unique_ptr<Private> d;
     };
@@ -29,6 +29,15 @@ Command open:
     --validateOnExtract    - validates container before extracting files
     --offline              - open container offline (eg. Don't send to SiVa)
 
+Command validateBatch:
+  Example: digidoc-tool validateBatch --threads=4 folder/containers
+  Validates listed containers and prints one JSON result per line. FILE is a directory,
+  a file with one container path per line or - to read paths from standard input.
+  Available options:
+    --threads=     - number of worker threads (default number of CPU cores)
+    --watch        - keep polling directory for new containers
+    --offline      - open containers offline (eg. Don't send to SiVa)
+
 Command add:
   Example: digidoc-tool add --file=file1.txt container-file.asice
   Available options:
@@ -31,10 +31,19 @@
 #include "util/File.h"
 #include "util/log.h"
 
+#include "json.hpp"
+
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <optional>
 #include <sstream>
+#include <thread>
 #include <unordered_map>
 
 #ifdef _WIN32
@@ -48,6 +57,7 @@
 using namespace digidoc;
 using namespace digidoc::util;
 using namespace std;
+using json = nlohmann::ordered_json;
 namespace fs = filesystem;
 
 namespace std
@@ -360,6 +370,17 @@ static int printUsage(const char *executable)
     << "      --extractAll[=path]    - extracts documents without validating signatures (to path when provided)" << endl
     << "      --validateOnExtract    - validates container before extracting files" << endl << endl
     << "      --offline              - open container offline (eg. Don't send to SiVa)" << endl << endl
+    << "  Command validateBatch:" << endl
+    << "    Example: " << executable << " validateBatch --threads=4 folder/containers" << endl
+    << "    Validates listed containers and prints one JSON result per line. FILE is a directory," << endl
+    << "    a file with one container path per line or - to read paths from standard input." << endl
+    << "    Available options:" << endl
+    << "      --threads=     - number of worker threads (default number of CPU cores)" << endl
+    << "      --watch        - keep polling directory for new and changed containers, file is picked up" << endl
+    << "                       when its size and modification time are unchanged between two polls;" << endl
+    << "                       write containers elsewhere and rename them into directory to avoid" << endl
+    << "                       validating partially written files" << endl
+    << "      --offline      - open containers offline (eg. Don't send to SiVa)" << endl << endl
     << "  Command add:" << endl
     << "    Example: " << executable << " add --file=file1.txt container-file.asice" << endl
     << "    Available options:" << endl
@@ -708,6 +729,241 @@ static int open(int argc, char* argv[])
     return returnCode;
 }
 
+/**
+ * Validate containers in batch with worker threads sharing trust store and configuration.
+ * Prints one JSON result per container with stage timings in milliseconds.
+ *
+ * @param argc number of command line arguments.
+ * @param argv command line arguments.
+ * @return EXIT_FAILURE (1) - failure, EXIT_SUCCESS (0) - success
+ */
+static int validateBatch(int argc, char *argv[])
+{
+    using clock = chrono::steady_clock;
+    unsigned int threads = max(thread::hardware_concurrency(), 1U);
+    bool watch = false;
+    value path;
+    struct OpenCB final: public ContainerOpenCB
+    {
+        bool online = true;
+        bool validateOnline() const final { return online; }
+    } cb;
+
+    // Parse command line arguments.
+    for(int i = 2; i < argc; i++)
+    {
+        string_view arg(argv[i]);
+        if(value v{arg, "--threads="})
+            threads = max(atoi(v.data()), 1);
+        else if(arg == "--watch")
+            watch = true;
+        else if(arg == "--offline")
+            cb.online = false;
+        else if(!arg.starts_with("--") || arg == "-")
+            path = arg;
+    }
+
+    if(path.empty())
+        return printUsage(argv[0]);
+    fs::path dir(path.begin(), path.end());
+    bool isDirectory = fs::is_directory(dir);
+    if(watch && !isDirectory)
+    {
+        cerr << "Option --watch requires a directory: " << path << endl;
+        return EXIT_FAILURE;
+    }
+
+    auto status = [](Signature::Validator::Status status) -> string_view {
+        switch(status)
+        {
+        case Signature::Validator::Valid: return "Valid";
+        case Signature::Validator::Warning: return "Warning";
+        case Signature::Validator::NonQSCD: return "NonQSCD";
+        case Signature::Validator::Test: return "Test";
+        case Signature::Validator::Unknown: return "Unknown";
+        case Signature::Validator::Invalid: return "Invalid";
+        }
+        return {};
+    };
+    auto str = [](const auto &value) {
+        stringstream os;
+        os << value;
+        return os.str();
+    };
+    auto ms = [](clock::time_point begin, clock::time_point end) {
+        return chrono::duration<double,milli>(end - begin).count();
+    };
+
+    mutex m;
+    condition_variable cv;
+    deque<string> queue;
+    bool done = false;
+    int returnCode = EXIT_SUCCESS;
+
+    auto validate = [&](const string &file) {
+        json result{{"file", file}};
+        bool valid = true;
+        optional<string> error;
+        auto begin = clock::now();
+        try {
+            unique_ptr<Container> doc = Container::openPtr(file, &cb);
+            auto opened = clock::now();
+            result["mediaType"] = doc->mediaType();
+            json signatures = json::array();
+            for(const Signature *s: doc->signatures())
+            {
+                Signature::Validator v(s);
+                json warnings = json::array();
+                for(Exception::ExceptionCode code: v.warnings())
+                    warnings.push_back(str(code));
+                signatures.push_back({
+                    {"id", s->id()},
+                    {"profile", s->profile()},
+                    {"signedBy", s->signedBy()},
+                    {"status", status(v.status())},
+                    {"warnings", std::move(warnings)},
+                    {"diagnostics", v.diagnostics()},
+                    {"checks", json::parse(v.report())["checks"]},
+                });
+                switch(v.status())
+                {
+                case Signature::Validator::Valid:
+                case Signature::Validator::Warning:
+                case Signature::Validator::NonQSCD: break;
+                default: valid = false;
+                }
+            }
+            auto validated = clock::now();
+            result["status"] = valid ? "valid" : "invalid";
+            result["signatures"] = std::move(signatures);
+            result["timings"] = {
+                {"open", ms(begin, opened)},
+                {"validate", ms(opened, validated)},
+                {"total", ms(begin, validated)},
+            };
+        } catch(const Exception &e) {
+            error = str(e);
+        } catch(const std::exception &e) {
+            error = e.what();
+        } catch(...) {
+            error = "Unknown error";
+        }
+        if(error)
+        {
+            valid = false;
+            result["status"] = "error";
+            result["error"] = *error;
+            result["timings"] = {{"total", ms(begin, clock::now())}};
+        }
+        string line = result.dump(-1, ' ', false, json::error_handler_t::replace);
+        lock_guard lock(m);
+        if(!valid)
+            returnCode = EXIT_FAILURE;
+        cout << line << '\n' << flush;
+    };
+
+    vector<thread> workers;
+    workers.reserve(threads);
+    for(unsigned int i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([&] {
+            for(;;)
+            {
+                unique_lock lock(m);
+                cv.wait(lock, [&] { return done || !queue.empty(); });
+                if(queue.empty())
+                    return;
+                string file = std::move(queue.front());
+                queue.pop_front();
+                lock.unlock();
+                validate(file);
+            }
+        });
+    }
+    auto enqueue = [&](string file) {
+        if(file.empty())
+            return;
+        {
+            lock_guard lock(m);
+            queue.push_back(std::move(file));
+        }
+        cv.notify_one();
+    };
+
+    int exitCode = EXIT_SUCCESS;
+    if(isDirectory)
+    {
+        // Spool directory, optionally polled for new and changed containers. While watching,
+        // file is queued after its size and modification time stay same for two polls.
+        struct Entry
+        {
+            uintmax_t size;
+            fs::file_time_type time;
+            bool queued;
+        };
+        map<fs::path,Entry> entries;
+        do {
+            error_code ec;
+            map<fs::path,Entry> current;
+            vector<fs::path> files;
+            for(const auto &file: fs::directory_iterator(dir, ec))
+            {
+                error_code fec;
+                if(!file.is_regular_file(fec))
+                    continue;
+                Entry entry{file.file_size(fec), {}, false};
+                if(fec)
+                    continue;
+                if(entry.time = file.last_write_time(fec); fec)
+                    continue;
+                auto i = entries.find(file.path());
+                bool stable = i != entries.cend() && i->second.size == entry.size && i->second.time == entry.time;
+                entry.queued = !watch || stable;
+                if(entry.queued && !(stable && i->second.queued))
+                    files.push_back(file.path());
+                current.emplace(file.path(), entry);
+            }
+            if(ec)
+            {
+                cerr << "Failed to open directory " << path << ": " << ec.message() << endl;
+                exitCode = EXIT_FAILURE;
+                break;
+            }
+            // Forget removed files, changed files are validated again
+            entries = std::move(current);
+            sort(files.begin(), files.end());
+            for(const fs::path &file: files)
+                enqueue(file.string());
+            if(watch)
+                this_thread::sleep_for(chrono::seconds(1));
+        } while(watch);
+    }
+    else if(path == "-")
+    {
+        for(string line; getline(cin, line);)
+            enqueue(std::move(line));
+    }
+    else if(ifstream list{dir}; list)
+    {
+        for(string line; getline(list, line);)
+            enqueue(std::move(line));
+    }
+    else
+    {
+        cerr << "Failed to open container list " << path << endl;
+        exitCode = EXIT_FAILURE;
+    }
+
+    {
+        lock_guard lock(m);
+        done = true;
+    }
+    cv.notify_all();
+    for(thread &worker: workers)
+        worker.join();
+    return exitCode == EXIT_SUCCESS ? returnCode : exitCode;
+}
+
 /**
  * Extend signatures in container.
  *
@@ -1096,9 +1352,11 @@ int main(int argc, char *argv[]) try
     codepage_scope scope{GetConsoleOutputCP()};
     SetConsoleOutputCP(CP_UTF8);
 #endif
-    printf("Version\n");
-    printf("  digidoc-tool version: %s\n", VERSION_STR);
-    printf("  libdigidocpp version: %s\n", version().c_str());
+    // Keep standard output machine readable for batch results
+    FILE *banner = argc > 1 && string_view(argv[1]) == "validateBatch" ? stderr : stdout;
+    fprintf(banner, "Version\n");
+    fprintf(banner, "  digidoc-tool version: %s\n", VERSION_STR);
+    fprintf(banner, "  libdigidocpp version: %s\n", version().c_str());
 
     ToolConfig *conf = nullptr;
     Conf::init(conf = new ToolConfig(argc, argv));
@@ -1139,6 +1397,8 @@ int main(int argc, char *argv[]) try
         return sign(*conf, argv[0]);
     if(command == "extend")
         return extend(argc, argv);
+    if(command == "validateBatch")
+        return validateBatch(argc, argv);
     if(command == "websign")
         return websign(*conf, argv[0]);
     if(command == "tsl")
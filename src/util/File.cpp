@@ -22,9 +22,11 @@
 #include "log.h"
 
 #include <algorithm>
+#include <atomic>
 #include <charconv>
 #include <ctime>
 #include <locale>
+#include <random>
 #include <sstream>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -36,6 +38,8 @@
 #include <sys/utime.h>
 #else
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/param.h>
 #include <pwd.h>
 #include <unistd.h>
@@ -242,6 +246,16 @@ fs::path File::tempFileName()
     return result;
 }
 
+/**
+ * Returns unique temporary file name in the directory of path, so that it can be renamed over path.
+ * Name is unique between threads and processes sharing the directory.
+ */
+string File::tempPath(const string &path)
+{
+    static atomic<uint64_t> counter {0};
+    return path + '.' + to_string(random_device{}()) + '-' + to_string(++counter) + ".tmp";
+}
+
 /**
  * Creates directory recursively. Also access rights can be omitted. Defaults are 700 in unix.
  *
@@ -361,3 +375,54 @@ vector<unsigned char> File::hexToBin(string_view in)
         out.emplace_back(value);
     return out;
 }
+
+/**
+ * Maps file read-only to memory.
+ *
+ * @param path file to be mapped.
+ * @return returns view to file content, mapping is released with last reference;
+ *         nullptr if the file is empty or can not be mapped.
+ */
+shared_ptr<const span<const byte>> File::map(const fs::path &path) noexcept
+{
+    using view = span<const byte>;
+    try {
+#ifdef _WIN32
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file == INVALID_HANDLE_VALUE)
+            return {};
+        LARGE_INTEGER size {};
+        HANDLE mapping {};
+        if(GetFileSizeEx(file, &size) && size.QuadPart > 0)
+            mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if(!mapping)
+            return {};
+        void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if(!data)
+            return {};
+        return {new view(static_cast<const byte*>(data), size_t(size.QuadPart)), [](const view *v) {
+            UnmapViewOfFile(v->data());
+            delete v;
+        }};
+#else
+        int fd = open(path.c_str(), O_RDONLY|O_CLOEXEC);
+        if(fd == -1)
+            return {};
+        f_statbuf fileInfo {};
+        void *data = MAP_FAILED;
+        if(fstat(fd, &fileInfo) == 0 && S_ISREG(fileInfo.st_mode) && fileInfo.st_size > 0)
+            data = mmap(nullptr, size_t(fileInfo.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(data == MAP_FAILED)
+            return {};
+        return {new view(static_cast<const byte*>(data), size_t(fileInfo.st_size)), [](const view *v) {
+            munmap(const_cast<byte*>(v->data()), v->size());
+            delete v;
+        }};
+#endif
+    } catch(const exception &) {
+        return {};
+    }
+}
@@ -22,6 +22,8 @@
 #include "../Exception.h"
 
 #include <filesystem>
+#include <memory>
+#include <span>
 
 namespace digidoc
 {
@@ -45,10 +47,12 @@ namespace digidoc
               static std::string directory(const std::string& path);
               static std::string path(std::string dir, std::string_view relativePath);
               static std::filesystem::path tempFileName();
+              static std::string tempPath(const std::string &path);
               static void createDirectory(std::string path);
               static std::string toUriPath(const std::string &path);
               static std::string fromUriPath(std::string_view path);
               static std::vector<unsigned char> hexToBin(std::string_view in);
+              static std::shared_ptr<const std::span<const std::byte>> map(const std::filesystem::path &path) noexcept;
 
         private:
 #ifdef _WIN32
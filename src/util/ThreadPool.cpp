@@ -0,0 +1,120 @@
+/*
+ * libdigidocpp
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "ThreadPool.h"
+
+#include "Conf.h"
+
+#include <algorithm>
+
+using namespace digidoc::util;
+using namespace std;
+
+ThreadPool::ThreadPool(size_t size)
+{
+    workers.reserve(size);
+    for(size_t i = 0; i < size; ++i)
+    {
+        workers.emplace_back([this] {
+            while(true)
+            {
+                unique_lock lock(m);
+                cond.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if(tasks.empty())
+                    return;
+                auto [group, task] = std::move(tasks.front());
+                tasks.pop_front();
+                lock.unlock();
+                task();
+                finish(group);
+            }
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() noexcept
+{
+    {
+        lock_guard lock(m);
+        stopping = true;
+    }
+    cond.notify_all();
+    for(thread &worker: workers)
+        worker.join();
+}
+
+/**
+ * Returns library wide pool, size is read from configuration on first use.
+ */
+ThreadPool& ThreadPool::instance()
+{
+    static ThreadPool pool([] {
+        int size = CONF(threadPoolSize);
+        return size > 0 ? size_t(size) : max<size_t>(1, thread::hardware_concurrency());
+    }());
+    return pool;
+}
+
+void ThreadPool::push(Group *group, function<void()> &&task)
+{
+    {
+        lock_guard lock(m);
+        tasks.push_back({group, std::move(task)});
+        ++group->pending;
+    }
+    cond.notify_one();
+}
+
+/**
+ * Runs one queued task of the group on calling thread.
+ * @return false when group has no queued tasks
+ */
+bool ThreadPool::runOne(const Group *group)
+{
+    unique_lock lock(m);
+    auto i = find_if(tasks.begin(), tasks.end(), [group](const Task &task) { return task.group == group; });
+    if(i == tasks.end())
+        return false;
+    auto [taskGroup, task] = std::move(*i);
+    tasks.erase(i);
+    lock.unlock();
+    task();
+    finish(taskGroup);
+    return true;
+}
+
+/**
+ * Marks task of the group completed.
+ */
+void ThreadPool::finish(Group *group) noexcept
+{
+    lock_guard lock(m);
+    if(--group->pending == 0)
+        finished.notify_all();
+}
+
+/**
+ * Runs queued tasks of the group on calling thread and waits until tasks running on workers complete.
+ */
+void ThreadPool::drain(const Group *group) noexcept
+{
+    while(runOne(group)) {}
+    unique_lock lock(m);
+    finished.wait(lock, [group] { return group->pending == 0; });
+}
@@ -0,0 +1,108 @@
+/*
+ * libdigidocpp
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace digidoc
+{
+    namespace util
+    {
+        /**
+         * Fixed size worker pool shared by parallel tasks of library.
+         *
+         * Tasks are submitted through a Group. Threads waiting for a result of the group run
+         * queued tasks of the same group meanwhile, so tasks can wait for tasks they submitted
+         * without exhausting the pool. Tasks of other groups are never run by the waiting thread,
+         * as it may hold locks the unrelated tasks depend on. Group runs or waits out all of
+         * its tasks before it is destroyed, so tasks may refer to locals of submitting scope
+         * even when it is left early by an exception.
+         */
+        class ThreadPool
+        {
+        public:
+            class Group
+            {
+            public:
+                explicit Group(ThreadPool &pool = ThreadPool::instance()) noexcept: pool(pool) {}
+                ~Group() noexcept { pool.drain(this); }
+
+                size_t size() const noexcept { return pool.size(); }
+
+                template<class F>
+                auto submit(F &&f)
+                {
+                    auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::forward<F>(f));
+                    auto result = task->get_future();
+                    pool.push(this, [task] { (*task)(); });
+                    return result;
+                }
+
+                template<class T>
+                T wait(std::future<T> &f)
+                {
+                    while(f.wait_for(std::chrono::seconds(0)) != std::future_status::ready && pool.runOne(this)) {}
+                    return f.get();
+                }
+
+            private:
+                Group(const Group&) = delete;
+                Group& operator=(const Group&) = delete;
+
+                ThreadPool &pool;
+                size_t pending = 0;
+                friend class ThreadPool;
+            };
+
+            explicit ThreadPool(size_t size);
+            ~ThreadPool() noexcept;
+            static ThreadPool& instance();
+
+            size_t size() const noexcept { return workers.size(); }
+
+        private:
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
+
+            struct Task
+            {
+                Group *group;
+                std::function<void()> run;
+            };
+
+            void push(Group *group, std::function<void()> &&task);
+            bool runOne(const Group *group);
+            void finish(Group *group) noexcept;
+            void drain(const Group *group) noexcept;
+
+            std::vector<std::thread> workers;
+            std::deque<Task> tasks;
+            std::condition_variable cond, finished;
+            std::mutex m;
+            bool stopping = false;
+        };
+    }
+}
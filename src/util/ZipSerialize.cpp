@@ -21,6 +21,7 @@
 
 #include "Container.h"
 #include "DateTime.h"
+#include "Metrics_p.h"
 #include "log.h"
 #include "File.h"
 
@@ -32,10 +33,204 @@
 #endif
 
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <istream>
 
 using namespace digidoc;
 using namespace std;
 
+static zlib_filefunc_def filefunc()
+{
+    zlib_filefunc_def def {};
+#ifdef _WIN32
+    fill_win32_filefunc(&def);
+#else
+    fill_fopen_filefunc(&def);
+#endif
+    return def;
+}
+
+/**
+ * Returns minizip IO functions reading the memory mapped ZIP file, so entries are read from the
+ * same file contents that were mapped when the ZIP file was opened.
+ */
+static zlib_filefunc64_def filefunc(const ZipSerialize::View &view)
+{
+    struct Cursor {
+        span<const byte> data;
+        ZPOS64_T pos = 0;
+    };
+    zlib_filefunc64_def def {};
+    def.opaque = const_cast<span<const byte>*>(view.get());
+    def.zopen64_file = [](voidpf opaque, const void * /*filename*/, int mode) -> voidpf {
+        if((mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER) != ZLIB_FILEFUNC_MODE_READ)
+            return nullptr;
+        return new(nothrow) Cursor{*static_cast<span<const byte>*>(opaque)};
+    };
+    def.zread_file = [](voidpf /*opaque*/, voidpf stream, void *buf, uLong size) -> uLong {
+        auto *c = static_cast<Cursor*>(stream);
+        size = uLong(min<ZPOS64_T>(size, c->data.size() - c->pos));
+        memcpy(buf, c->data.data() + c->pos, size);
+        c->pos += size;
+        return size;
+    };
+    def.zwrite_file = [](voidpf /*opaque*/, voidpf /*stream*/, const void * /*buf*/, uLong /*size*/) -> uLong {
+        return 0;
+    };
+    def.ztell64_file = [](voidpf /*opaque*/, voidpf stream) -> ZPOS64_T {
+        return static_cast<Cursor*>(stream)->pos;
+    };
+    def.zseek64_file = [](voidpf /*opaque*/, voidpf stream, ZPOS64_T offset, int origin) -> long {
+        auto *c = static_cast<Cursor*>(stream);
+        ZPOS64_T base = 0;
+        switch(origin)
+        {
+        case ZLIB_FILEFUNC_SEEK_SET: break;
+        case ZLIB_FILEFUNC_SEEK_CUR: base = c->pos; break;
+        case ZLIB_FILEFUNC_SEEK_END: base = c->data.size(); break;
+        default: return -1;
+        }
+        if(offset > c->data.size() - base)
+            return -1;
+        c->pos = base + offset;
+        return 0;
+    };
+    def.zclose_file = [](voidpf /*opaque*/, voidpf stream) -> int {
+        delete static_cast<Cursor*>(stream);
+        return 0;
+    };
+    def.zerror_file = [](voidpf /*opaque*/, voidpf /*stream*/) -> int {
+        return 0;
+    };
+    return def;
+}
+
+namespace
+{
+
+/**
+ * Decompresses ZIP entry on demand from memory mapped ZIP file. Mapping is kept for the lifetime
+ * of the stream, so the entry does not change when the file is replaced or deleted meanwhile.
+ * Decompressor is opened on first read and closed after the last byte of entry is consumed, so
+ * idle streams do not hold decompressed data.
+ *
+ * Every decompression pass starts from the beginning of the entry and all inflated bytes are
+ * passed to optional sink, which is notified with empty data when the CRC of completed pass is
+ * verified.
+ */
+class ZipEntryBuf: public streambuf
+{
+public:
+    ZipEntryBuf(ZipSerialize::View view, ZPOS64_T offset, ZPOS64_T size, ZipSerialize::Sink &&sink)
+        : view(std::move(view))
+        , offset(offset)
+        , size(size)
+        , sink(std::move(sink))
+    {}
+
+private:
+    void open()
+    {
+        zlib_filefunc64_def def = filefunc(view);
+        zip.reset(unzOpen2_64("", &def));
+        if(!zip)
+            THROW("Failed to open ZIP file.");
+        if(int unzResult = unzSetOffset64(zip.get(), offset); unzResult != UNZ_OK)
+            THROW("Failed to locate entry inside ZIP container. ZLib error: %d", unzResult);
+        if(int unzResult = unzOpenCurrentFile(zip.get()); unzResult != UNZ_OK)
+            THROW("Failed to open entry inside ZIP container. ZLib error: %d", unzResult);
+        cur = 0;
+    }
+
+    size_t read(char *data, size_t len)
+    {
+        int result = unzReadCurrentFile(zip.get(), data, unsigned(len));
+        if(result < UNZ_EOF)
+            THROW("Failed to read bytes from ZIP container. ZLib error: %d", result);
+        if(result == UNZ_EOF && cur < size)
+            THROW("ZIP entry actual size is smaller than uncompressed_size %llu", (unsigned long long)size);
+        if(cur + ZPOS64_T(result) > size)
+            THROW("ZIP entry actual size exceeds uncompressed_size %llu", (unsigned long long)size);
+        MetricsPrivate::add(MetricsPrivate::ZipInflatedBytes, uint64_t(result));
+        if(sink && result > 0)
+            sink(cur, {data, size_t(result)});
+        if(cur += ZPOS64_T(result); cur == size)
+        {
+            if(int unzResult = unzCloseCurrentFile(zip.get()); unzResult != UNZ_OK)
+                THROW("Failed to verify entry inside ZIP container. ZLib error: %d", unzResult);
+            zip.reset();
+            if(sink)
+                sink(cur, {});
+        }
+        return size_t(result);
+    }
+
+    int_type underflow() final
+    {
+        if(gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+        if(pos >= size)
+            return traits_type::eof();
+        if(!zip || cur > pos)
+            open();
+        while(cur < pos)
+            read(buf.data(), size_t(min<ZPOS64_T>(buf.size(), pos - cur)));
+        size_t result = read(buf.data(), buf.size());
+        pos = cur;
+        setg(buf.data(), buf.data(), buf.data() + result);
+        return result > 0 ? traits_type::to_int_type(*gptr()) : traits_type::eof();
+    }
+
+    pos_type seekoff(off_type off, ios_base::seekdir dir, ios_base::openmode which) final
+    {
+        if(!(which & ios_base::in))
+            return pos_type(off_type(-1));
+        off_type current = off_type(pos) - off_type(egptr() - gptr());
+        off_type target = off;
+        switch(dir)
+        {
+        case ios_base::beg: break;
+        case ios_base::cur: target += current; break;
+        case ios_base::end: target += off_type(size); break;
+        default: return pos_type(off_type(-1));
+        }
+        if(target < 0 || ZPOS64_T(target) > size)
+            return pos_type(off_type(-1));
+        if(off_type begin = off_type(pos) - off_type(egptr() - eback()); target >= begin && target <= off_type(pos))
+            setg(eback(), eback() + (target - begin), egptr());
+        else
+        {
+            pos = ZPOS64_T(target);
+            setg(buf.data(), buf.data(), buf.data());
+        }
+        return pos_type(target);
+    }
+
+    pos_type seekpos(pos_type sp, ios_base::openmode which) final
+    {
+        return seekoff(off_type(sp), ios_base::beg, which);
+    }
+
+    ZipSerialize::View view;
+    ZPOS64_T offset, size, pos = 0, cur = 0;
+    unique_ptr<void, int(*)(void*)> zip{nullptr, unzClose};
+    ZipSerialize::Sink sink;
+    array<char, 10240> buf{};
+};
+
+class ZipEntryStream final: private ZipEntryBuf, public istream
+{
+public:
+    ZipEntryStream(ZipSerialize::View view, ZPOS64_T offset, ZPOS64_T size, ZipSerialize::Sink &&sink)
+        : ZipEntryBuf(std::move(view), offset, size, std::move(sink))
+        , istream(this)
+    {}
+};
+
+}
+
 /**
  * Initializes ZIP file serializer.
  *
@@ -43,13 +238,9 @@ using namespace std;
  */
 ZipSerialize::ZipSerialize(const string &path, bool create)
     : d{nullptr, create ? [](void *handle) { return zipClose(handle, appInfo().c_str()); } : &unzClose}
+    , p(path)
 {
-    zlib_filefunc_def def {};
-#ifdef _WIN32
-    fill_win32_filefunc(&def);
-#else
-    fill_fopen_filefunc(&def);
-#endif
+    zlib_filefunc_def def = filefunc();
     if(create)
     {
         DEBUG("ZipSerialize::create(%s)", path.c_str());
@@ -60,7 +251,13 @@ ZipSerialize::ZipSerialize(const string &path, bool create)
     else
     {
         DEBUG("ZipSerialize::open(%s)", path.c_str());
-        d.reset(unzOpen2((const char*)util::File::encodeName(path).c_str(), &def));
+        if(m = util::File::map(util::File::encodeName(path)); m)
+        {
+            zlib_filefunc64_def mapped = filefunc(m);
+            d.reset(unzOpen2_64("", &mapped));
+        }
+        else
+            d.reset(unzOpen2((const char*)util::File::encodeName(path).c_str(), &def));
         if(!d)
             THROW("Failed to open ZIP file '%s'.", path.c_str());
     }
@@ -132,16 +329,88 @@ ZipSerialize::Read ZipSerialize::read(string_view file) const
     return {{d.get(), unzCloseCurrentFile}, size_t(info.uncompressed_size)};
 }
 
+/**
+ * Returns stream that decompresses the file on demand. Only entry location and size are read
+ * from the central directory, the entry is decompressed from memory mapped ZIP file when stream
+ * is read.
+ *
+ * @param file path to opened ZIP in file.
+ * @param sink optional callback that receives decompressed data while stream is read.
+ * @return stream to file content, nullptr if the ZIP file is not mapped.
+ * @throws Exception throws exception if the file is not found.
+ */
+unique_ptr<istream> ZipSerialize::stream(string_view file, Sink &&sink) const
+{
+    if(!d)
+        THROW("Zip file is not open");
+
+    if(!m)
+        return {};
+    DEBUG("ZipSerialize::stream(%.*s)", int(file.size()), file.data());
+    if(file.empty() || file.back() == '/')
+        return make_unique<ZipEntryStream>(m, 0, 0, Sink{});
+
+    int unzResult = unzLocateFile(d.get(), file.data(), 1);
+    if(unzResult != UNZ_OK)
+        THROW("Failed to locate '%.*s' inside ZIP container. ZLib error: %d", int(file.size()), file.data(), unzResult);
+
+    unz_file_info64 info {};
+    unzResult = unzGetCurrentFileInfo64(d.get(), &info, nullptr, 0, nullptr, 0, nullptr, 0);
+    if(unzResult != UNZ_OK)
+        THROW("Failed to get file info of '%.*s' inside ZIP container. ZLib error: %d", int(file.size()), file.data(), unzResult);
+
+    return make_unique<ZipEntryStream>(m, unzGetOffset64(d.get()), info.uncompressed_size, std::move(sink));
+}
+
+/**
+ * Returns STORED (uncompressed) file content from memory mapped ZIP file without copying.
+ *
+ * @param file path to opened ZIP in file.
+ * @return view to file content, nullptr if the file is compressed or ZIP file is not mapped.
+ * @throws Exception throws exception if the file is not found or exceeds ZIP file bounds.
+ */
+ZipSerialize::View ZipSerialize::stored(string_view file) const
+{
+    if(!d)
+        THROW("Zip file is not open");
+    if(!m || file.empty() || file.back() == '/')
+        return {};
+
+    int unzResult = unzLocateFile(d.get(), file.data(), 1);
+    if(unzResult != UNZ_OK)
+        THROW("Failed to locate '%.*s' inside ZIP container. ZLib error: %d", int(file.size()), file.data(), unzResult);
+
+    unz_file_info64 info {};
+    unzResult = unzGetCurrentFileInfo64(d.get(), &info, nullptr, 0, nullptr, 0, nullptr, 0);
+    if(unzResult != UNZ_OK)
+        THROW("Failed to get file info of '%.*s' inside ZIP container. ZLib error: %d", int(file.size()), file.data(), unzResult);
+    // general purpose bit 0 for encryption
+    if(info.compression_method != 0 || (info.flag & 1) || info.compressed_size != info.uncompressed_size)
+        return {};
+
+    unzResult = unzOpenCurrentFile(d.get());
+    if(unzResult != UNZ_OK)
+        THROW("Failed to open '%.*s' inside ZIP container. ZLib error: %d", int(file.size()), file.data(), unzResult);
+    ZPOS64_T pos = unzGetCurrentFileZStreamPos64(d.get());
+    unzCloseCurrentFile(d.get());
+    if(pos > m->size() || info.uncompressed_size > m->size() - pos)
+        THROW("ZIP entry '%.*s' exceeds ZIP file size", int(file.size()), file.data());
+
+    DEBUG("ZipSerialize::stored(%.*s)", int(file.size()), file.data());
+    auto entry = make_shared<pair<View,span<const byte>>>(m, m->subspan(size_t(pos), size_t(info.uncompressed_size)));
+    return {entry, &entry->second};
+}
+
 /**
  * Add new file to ZIP container.
  *
  * @param containerPath file path inside ZIP file.
  * @param prop Properties added for file in ZIP file.
- * @param compress File should be compressed in ZIP file.
+ * @param level compression level, STORED (0) writes file without compression.
  * @return Write struct for data input
  * @throws Exception throws exception if there were errors during locating files in zip.
  */
-ZipSerialize::Write ZipSerialize::addFile(string_view containerPath, const Properties &prop, bool compress) const
+ZipSerialize::Write ZipSerialize::addFile(string_view containerPath, const Properties &prop, int level) const
 {
     if(!d)
         THROW("Zip file is not open");
@@ -154,8 +423,7 @@ ZipSerialize::Write ZipSerialize::addFile(string_view containerPath, const Prope
         0, 0, 0 };
 
     // Create new file inside ZIP container.
-    int method = compress ? Z_DEFLATED : Z_NULL;
-    int level = compress ? Z_DEFAULT_COMPRESSION : Z_NO_COMPRESSION;
+    int method = level == STORED ? Z_NULL : Z_DEFLATED;
     static constexpr uLong UTF8_encoding = 1 << 11; // general purpose bit 11 for unicode
     int zipResult = zipOpenNewFileInZip4(d.get(), containerPath.data(),
         &info, nullptr, 0, nullptr, 0, prop.comment.c_str(), method, level, 0,
@@ -163,9 +431,114 @@ ZipSerialize::Write ZipSerialize::addFile(string_view containerPath, const Prope
     if(zipResult != ZIP_OK)
         THROW("Failed to create new file inside ZIP container. ZLib error: %d", zipResult);
 
+    return {{d.get(), zipCloseFileInZip}, 0, 0, method == Z_DEFLATED};
+}
+
+/**
+ * Add new file to ZIP container that is written as already deflated chunks.
+ *
+ * @param containerPath file path inside ZIP file.
+ * @param prop Properties added for file in ZIP file.
+ * @param level compression level chunks were deflated with, stored in ZIP header flags.
+ * @return Write struct for deflated chunks, must be finished with Write::close()
+ * @throws Exception throws exception if there were errors during locating files in zip.
+ * @see deflate
+ */
+ZipSerialize::Write ZipSerialize::addRawFile(string_view containerPath, const Properties &prop, int level) const
+{
+    if(!d)
+        THROW("Zip file is not open");
+
+    DEBUG("ZipSerialize::addRawFile(%.*s)", int(containerPath.size()), containerPath.data());
+    tm time = util::date::gmtime(prop.time);
+    zip_fileinfo info {
+        { time.tm_sec, time.tm_min, time.tm_hour,
+          time.tm_mday, time.tm_mon, time.tm_year },
+        0, 0, 0 };
+
+    static constexpr uLong UTF8_encoding = 1 << 11; // general purpose bit 11 for unicode
+    int zipResult = zipOpenNewFileInZip4(d.get(), containerPath.data(),
+        &info, nullptr, 0, nullptr, 0, prop.comment.c_str(), Z_DEFLATED, level, 1,
+        -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY, nullptr, 0, 0, UTF8_encoding);
+    if(zipResult != ZIP_OK)
+        THROW("Failed to create new file inside ZIP container. ZLib error: %d", zipResult);
+
     return {{d.get(), zipCloseFileInZip}};
 }
 
+/**
+ * Deflates chunk of file independently from other chunks, so that the chunks can be compressed
+ * in parallel and concatenated into one raw deflate stream.
+ *
+ * @param data chunk to compress.
+ * @param dictionary up to 32KiB of data preceding the chunk, improves compression ratio.
+ * @param last chunk finishes the deflate stream.
+ * @param level compression level 1-9 or DEFAULT_LEVEL, must be same for all chunks of file.
+ * @throws Exception throws exception if compression fails.
+ */
+ZipSerialize::Chunk ZipSerialize::deflate(span<const char> data, span<const char> dictionary, bool last, int level)
+{
+    z_stream s {};
+    if(int result = deflateInit2(&s, level, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY); result != Z_OK)
+        THROW("Failed to initialize compression. ZLib error: %d", result);
+    unique_ptr<z_stream, int(*)(z_stream*)> guard(&s, deflateEnd);
+    if(dictionary.size() > DICT_SIZE)
+        dictionary = dictionary.last(DICT_SIZE);
+    if(!dictionary.empty())
+    {
+        if(int result = deflateSetDictionary(&s, (const Bytef*)dictionary.data(), uInt(dictionary.size())); result != Z_OK)
+            THROW("Failed to set compression dictionary. ZLib error: %d", result);
+    }
+
+    MetricsPrivate::add(MetricsPrivate::ZipDeflatedBytes, data.size());
+    Chunk chunk { string(deflateBound(&s, uLong(data.size())) + 16, 0),
+        crc32(0, (const Bytef*)data.data(), uInt(data.size())), data.size() };
+    s.next_in = (Bytef*)data.data();
+    s.avail_in = uInt(data.size());
+    // Non-final chunks end with an empty stored block on a byte boundary
+    const int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+    for(int result = Z_OK; ; )
+    {
+        if(s.total_out == chunk.data.size())
+            chunk.data.resize(chunk.data.size() * 2);
+        s.next_out = (Bytef*)chunk.data.data() + s.total_out;
+        s.avail_out = uInt(chunk.data.size() - s.total_out);
+        result = ::deflate(&s, flush);
+        if(result == Z_STREAM_END || (result == Z_OK && !last && s.avail_out > 0))
+            break;
+        if(result != Z_OK && result != Z_BUF_ERROR)
+            THROW("Failed to compress data. ZLib error: %d", result);
+    }
+    chunk.data.resize(s.total_out);
+    return chunk;
+}
+
+/**
+ * Probes if data is worth compressing. Estimates Shannon entropy of byte distribution,
+ * already compressed or encrypted data is close to 8 bits per byte.
+ *
+ * @param data sample of file, usually first chunk.
+ * @return false if data looks like already compressed.
+ */
+bool ZipSerialize::compressible(span<const char> data)
+{
+    // Too small sample to get reliable estimate
+    if(data.size() < 4096)
+        return true;
+    array<size_t,256> count{};
+    for(char c: data)
+        ++count[(unsigned char)c];
+    double entropy = 0;
+    for(size_t c: count)
+    {
+        if(c == 0)
+            continue;
+        double p = double(c) / double(data.size());
+        entropy -= p * log2(p);
+    }
+    return entropy < 7.5;
+}
+
 /**
  * Reads mimetype.
  *
@@ -219,7 +592,10 @@ size_t ZipSerialize::Read::operator()(void *data, size_t size) const
 {
     auto result = unzReadCurrentFile(d.get(), data, size);
     if(result >= UNZ_EOF)
+    {
+        MetricsPrivate::add(MetricsPrivate::ZipInflatedBytes, uint64_t(result));
         return size_t(result);
+    }
     THROW("Failed to read bytes from ZIP container. ZLib error: %d", result);
 }
 
@@ -227,4 +603,19 @@ void ZipSerialize::Write::operator()(const void *data, size_t size) const
 {
     if(auto result = zipWriteInFileInZip(d.get(), data, unsigned(size)); result != ZIP_OK)
         THROW("Failed to write bytes to current file inside ZIP container. ZLib error: %d", result);
+    if(deflated)
+        MetricsPrivate::add(MetricsPrivate::ZipDeflatedBytes, size);
+}
+
+void ZipSerialize::Write::operator()(const Chunk &chunk)
+{
+    operator()(chunk.data.data(), chunk.data.size());
+    crc = crc32_combine(crc, chunk.crc, z_off_t(chunk.size));
+    size += chunk.size;
+}
+
+void ZipSerialize::Write::close()
+{
+    if(auto result = zipCloseFileInZipRaw64(d.release(), size, crc); result != ZIP_OK)
+        THROW("Failed to close file inside ZIP container. ZLib error: %d", result);
 }
@@ -22,7 +22,10 @@
 #include "Exports.h"
 #include "log.h"
 
+#include <functional>
+#include <istream>
 #include <memory>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -54,16 +57,29 @@ public:
         std::unique_ptr<void, int (*)(void*)> d;
         size_t size;
     };
+    struct Chunk {
+        std::string data;
+        unsigned long crc;
+        size_t size;
+    };
     struct Write {
         void operator ()(const void *data, size_t size) const;
+        void operator ()(const Chunk &chunk);
         template<class T>
         constexpr void operator ()(const T &data) const
         {
             operator ()(data.data(), data.size());
         }
+        void close();
         std::unique_ptr<void, int (*)(void*)> d;
+        uint64_t size = 0;
+        unsigned long crc = 0;
+        bool deflated = false;
     };
 
+    using View = std::shared_ptr<const std::span<const std::byte>>;
+    using Sink = std::function<void (uint64_t offset, std::span<const char> data)>;
+
     struct Properties {
         std::string comment;
         time_t time;
@@ -72,13 +88,26 @@ public:
 
     ZipSerialize(const std::string &path, bool create);
 
+    const std::string &path() const { return p; }
     std::vector<std::string> list() const;
-    Write addFile(std::string_view containerPath, const Properties &prop, bool compress = true) const;
+    Write addFile(std::string_view containerPath, const Properties &prop, int level = DEFAULT_LEVEL) const;
+    Write addRawFile(std::string_view containerPath, const Properties &prop, int level = DEFAULT_LEVEL) const;
     std::string mimetype() const;
     Read read(std::string_view file) const;
+    std::unique_ptr<std::istream> stream(std::string_view file, Sink &&sink = {}) const;
+    View stored(std::string_view file) const;
     Properties properties(const std::string &file) const;
 
+    static constexpr int DEFAULT_LEVEL = -1;
+    static constexpr int STORED = 0;
+    static constexpr size_t CHUNK_SIZE = 256UL*1024;
+    static constexpr size_t DICT_SIZE = 32UL*1024;
+    static Chunk deflate(std::span<const char> data, std::span<const char> dictionary, bool last, int level = DEFAULT_LEVEL);
+    static bool compressible(std::span<const char> data);
+
 private:
     std::unique_ptr<void, int(*)(void*)> d;
+    View m;
+    std::string p;
 };
 }
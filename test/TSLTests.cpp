@@ -21,6 +21,7 @@
 #include "test.h"
 
 #include <Signature.h>
+#include <crypto/TSL.h>
 
 #include <fstream>
 
@@ -54,4 +55,128 @@ BOOST_AUTO_TEST_CASE(TSLCase)
     }
 }
 
+struct Source
+{
+    TSL::Lists load(const TSL::Lists &previous = {}) const
+    {
+        return TSL::load(url, certs, cache, territory, previous);
+    }
+
+    string url = CONF(TSLUrl);
+    string cache = CONF(TSLCache);
+    string territory = util::File::fileName(url);
+    vector<X509Cert> certs = CONF(TSLCerts);
+    string snapshot = util::File::path(cache, territory + ".snapshot");
+};
+
+static string readFile(const string &path)
+{
+    stringstream content;
+    content << ifstream(path, ifstream::binary).rdbuf();
+    return content.str();
+}
+
+BOOST_AUTO_TEST_CASE(TamperedSnapshotIsIgnored)
+{
+    Source source;
+    fs::remove(source.snapshot);
+    TSL::Lists lists = source.load();
+    BOOST_REQUIRE(!lists.empty() && !lists.front()->services.empty());
+    string name = lists.front()->services.front().name;
+    string original = readFile(source.snapshot);
+    size_t pos = original.find(name);
+    BOOST_REQUIRE(!name.empty() && pos != string::npos);
+
+    // Well-formed snapshot with modified service
+    string tampered = original;
+    tampered[pos] = tampered[pos] == 'X' ? 'Y' : 'X';
+    ofstream(source.snapshot, ofstream::binary|ofstream::trunc) << tampered;
+    lists = source.load();
+    BOOST_REQUIRE(!lists.empty() && !lists.front()->services.empty());
+    BOOST_CHECK_EQUAL(lists.front()->services.front().name, name);
+    BOOST_CHECK(readFile(source.snapshot) == original);
+    fs::remove(source.snapshot);
+}
+
+BOOST_AUTO_TEST_CASE(CorruptedSnapshotIsIgnored)
+{
+    Source source;
+    fs::remove(source.snapshot);
+    TSL::Lists lists = source.load();
+    BOOST_REQUIRE(!lists.empty());
+    string original = readFile(source.snapshot);
+    BOOST_REQUIRE(!original.empty());
+
+    ofstream(source.snapshot, ofstream::binary|ofstream::trunc) << original.substr(0, original.size() / 2);
+    TSL::Lists reloaded = source.load();
+    BOOST_REQUIRE_EQUAL(reloaded.size(), lists.size());
+    BOOST_CHECK_EQUAL(reloaded.front()->sequenceNumber, lists.front()->sequenceNumber);
+    BOOST_CHECK_EQUAL(reloaded.front()->services.size(), lists.front()->services.size());
+    BOOST_CHECK(readFile(source.snapshot) == original);
+    fs::remove(source.snapshot);
+}
+
+BOOST_AUTO_TEST_CASE(UnchangedListIsReused)
+{
+    Source source;
+    TSL::Lists lists = source.load();
+    BOOST_REQUIRE(!lists.empty());
+    TSL::Lists reloaded = source.load(lists);
+    BOOST_REQUIRE_EQUAL(reloaded.size(), lists.size());
+    BOOST_CHECK(reloaded.front() == lists.front());
+    fs::remove(source.snapshot);
+}
+
+BOOST_AUTO_TEST_CASE(ChangedListIsReloaded)
+{
+    Source source;
+    string path = util::File::path(source.cache, source.territory);
+    TSL::Lists lists = source.load();
+    BOOST_REQUIRE(!lists.empty());
+
+    ofstream(path + ".etag", ofstream::trunc) << "changed";
+    TSL::Lists reloaded = source.load(lists);
+    fs::remove(path + ".etag");
+    BOOST_REQUIRE(!reloaded.empty());
+    BOOST_CHECK(reloaded.front() != lists.front());
+    BOOST_CHECK_EQUAL(reloaded.front()->sequenceNumber, lists.front()->sequenceNumber);
+
+    // Whitespace after document element does not change signed content
+    string content = readFile(path);
+    ofstream(path, ofstream::binary|ofstream::app) << '\n';
+    reloaded = source.load(lists);
+    ofstream(path, ofstream::binary|ofstream::trunc) << content;
+    BOOST_REQUIRE(!reloaded.empty());
+    BOOST_CHECK(reloaded.front() != lists.front());
+    BOOST_CHECK_EQUAL(reloaded.front()->sequenceNumber, lists.front()->sequenceNumber);
+    fs::remove(source.snapshot);
+}
+
+BOOST_AUTO_TEST_CASE(ExpiredListIsReloaded)
+{
+    Source source;
+    TSL::Lists lists = source.load();
+    BOOST_REQUIRE(!lists.empty());
+    auto expired = make_shared<TSL::List>(*lists.front());
+    expired->nextUpdate = "2000-01-01T00:00:00Z";
+    TSL::Lists reloaded = source.load({expired});
+    BOOST_REQUIRE(!reloaded.empty());
+    BOOST_CHECK(reloaded.front() != expired);
+    BOOST_CHECK_EQUAL(reloaded.front()->nextUpdate, lists.front()->nextUpdate);
+    fs::remove(source.snapshot);
+}
+
+BOOST_AUTO_TEST_CASE(FailedDownloadKeepsCachedList)
+{
+    // Unique per test run, runs may be parallel
+    string path = Source().territory + ".fetch.tmp";
+    ofstream(path) << "cached";
+    BOOST_CHECK_THROW(TSL::fetch("http://127.0.0.1:1/TSL.xml", path), Exception);
+    BOOST_CHECK_EQUAL(readFile(path), "cached");
+    BOOST_CHECK(none_of(fs::directory_iterator("."), fs::directory_iterator(), [&path](const auto &file) {
+        return file.path().filename().string().starts_with(path + '.');
+    }));
+    fs::remove(path);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
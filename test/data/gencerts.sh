@@ -26,3 +26,8 @@ openssl pkcs12 -export -in signerEC.crt -inkey signerEC.key -out signerEC.p12 -p
 
 openssl req -out unicode.req -new -newkey ec:<(openssl ecparam -name secp384r1) -nodes -keyout unicode.key -subj "/C=EE/CN=unicodeöäüõ" -utf8
 openssl x509 -req -in unicode.req -out unicode.crt -signkey unicode.key -days 365 -sha512
+
+for c in LV LT; do
+	openssl req -x509 -out signer$c.crt -new -newkey rsa:2048 -nodes -keyout signer$c.key -subj "/C=$c/CN=signer $c" -config ./openssl.conf -extensions v3_usr -days 3650 -sha512
+	openssl pkcs12 -export -in signer$c.crt -inkey signer$c.key -out signer$c.p12 -password pass:signer$c
+done
@@ -22,14 +22,31 @@
 
 #include <boost/mpl/list.hpp>
 
-#include <DataFile.h>
+#include <random>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <DataFile_p.h>
+#include <Metrics.h>
 #include <Signature.h>
 #include <XmlConf.h>
 #include <XMLDocument.h>
+#include <crypto/Connect.h>
 #include <crypto/Digest.h>
+#include <crypto/OpenSSLHelpers.h>
 #include <crypto/PKCS12Signer.h>
 #include <crypto/X509Crypto.h>
 #include <util/DateTime.h>
+#include <util/ThreadPool.h>
+
+#include <openssl/ocsp.h>
+#include <openssl/pkcs12.h>
+#include <xmlsec/templates.h>
 
 namespace digidoc
 {
@@ -134,6 +151,133 @@ BOOST_AUTO_TEST_CASE(parameters)
     BOOST_CHECK_EQUAL(c.keyUsage(), vector<X509Cert::KeyUsage>{ X509Cert::NonRepudiation});
     BOOST_CHECK_EQUAL(c.isValid(), true);
 }
+
+static X509Cert makeCert(const char *cn, EVP_PKEY *key, const char *issuer, EVP_PKEY *issuerKey,
+    const vector<unsigned char> &ski = {}, const vector<unsigned char> &aki = {})
+{
+    auto x509 = make_unique_ptr<X509_free>(X509_new());
+    X509_set_version(x509.get(), X509_VERSION_3);
+    ASN1_INTEGER_set(X509_get_serialNumber(x509.get()), long(time(nullptr)));
+    X509_gmtime_adj(X509_getm_notBefore(x509.get()), -86400);
+    X509_gmtime_adj(X509_getm_notAfter(x509.get()), 86400);
+    auto name = [](const char *cn) {
+        auto name = make_unique_ptr<X509_NAME_free>(X509_NAME_new());
+        X509_NAME_add_entry_by_txt(name.get(), "CN", MBSTRING_UTF8, (const unsigned char*)cn, -1, -1, 0);
+        return name;
+    };
+    X509_set_subject_name(x509.get(), name(cn).get());
+    X509_set_issuer_name(x509.get(), name(issuer).get());
+    X509_set_pubkey(x509.get(), key);
+    if(key == issuerKey)
+    {
+        auto bc = make_unique_ptr<BASIC_CONSTRAINTS_free>(BASIC_CONSTRAINTS_new());
+        bc->ca = 1;
+        X509_add1_ext_i2d(x509.get(), NID_basic_constraints, bc.get(), 1, 0);
+    }
+    if(!ski.empty())
+    {
+        auto id = make_unique_ptr<ASN1_OCTET_STRING_free>(ASN1_OCTET_STRING_new());
+        ASN1_OCTET_STRING_set(id.get(), ski.data(), int(ski.size()));
+        X509_add1_ext_i2d(x509.get(), NID_subject_key_identifier, id.get(), 0, 0);
+    }
+    if(!aki.empty())
+    {
+        auto id = make_unique_ptr<AUTHORITY_KEYID_free>(AUTHORITY_KEYID_new());
+        id->keyid = ASN1_OCTET_STRING_new();
+        ASN1_OCTET_STRING_set(id->keyid, aki.data(), int(aki.size()));
+        X509_add1_ext_i2d(x509.get(), NID_authority_key_identifier, id.get(), 0, 0);
+    }
+    BOOST_REQUIRE(X509_sign(x509.get(), issuerKey, EVP_sha256()) > 0);
+    return X509Cert(x509.get());
+}
+
+BOOST_AUTO_TEST_CASE(IssuerWithoutSKIFoundBySubject)
+{
+    auto tslKey = make_unique_ptr<EVP_PKEY_free>(EVP_RSA_gen(2048));
+    auto caKey = make_unique_ptr<EVP_PKEY_free>(EVP_EC_gen("P-256"));
+    auto otherKey = make_unique_ptr<EVP_PKEY_free>(EVP_EC_gen("P-256"));
+    auto userKey = make_unique_ptr<EVP_PKEY_free>(EVP_EC_gen("P-256"));
+    vector<unsigned char> keyId(20, 0x42);
+    X509Cert tslCert = makeCert("Test TSL", tslKey.get(), "Test TSL", tslKey.get());
+    // Issuer has no SKI, other listed CA has SKI that user certificate refers to
+    X509Cert ca = makeCert("No SKI CA", caKey.get(), "No SKI CA", caKey.get());
+    X509Cert other = makeCert("Other CA", otherKey.get(), "Other CA", otherKey.get(), keyId);
+    X509Cert user = makeCert("No SKI user", userKey.get(), "No SKI CA", caKey.get(), {}, keyId);
+
+    auto service = [](const char *name, const X509Cert &cert) {
+        vector<unsigned char> der = cert;
+        return Log::format(R"(<TSPService><ServiceInformation>
+<ServiceTypeIdentifier>http://uri.etsi.org/TrstSvc/Svctype/CA/QC</ServiceTypeIdentifier>
+<ServiceName><Name xml:lang="en">%s</Name></ServiceName>
+<ServiceDigitalIdentity><DigitalId><X509Certificate>%s</X509Certificate></DigitalId></ServiceDigitalIdentity>
+<ServiceStatus>http://uri.etsi.org/TrstSvc/TrustedList/Svcstatus/granted</ServiceStatus>
+<StatusStartingTime>2000-01-01T00:00:00Z</StatusStartingTime>
+</ServiceInformation></TSPService>)", name, to_base64(der).c_str());
+    };
+    string address = R"(<PostalAddresses><PostalAddress xml:lang="en"><StreetAddress>Test</StreetAddress>
+<Locality>Test</Locality><CountryName>EE</CountryName></PostalAddress></PostalAddresses>
+<ElectronicAddress><URI xml:lang="en">mailto:test@test.ee</URI></ElectronicAddress>)";
+    string xml = R"(<?xml version="1.0" encoding="UTF-8"?>
+<TrustServiceStatusList xmlns="http://uri.etsi.org/02231/v2#" Id="TSL" TSLTag="http://uri.etsi.org/19612/TSLTag"><SchemeInformation>
+<TSLVersionIdentifier>5</TSLVersionIdentifier>
+<TSLSequenceNumber>1</TSLSequenceNumber>
+<TSLType>http://uri.etsi.org/TrstSvc/TrustedList/TSLType/EUgeneric</TSLType>
+<SchemeOperatorName><Name xml:lang="en">Test</Name></SchemeOperatorName>
+<SchemeOperatorAddress>)" + address + R"(</SchemeOperatorAddress>
+<SchemeName><Name xml:lang="en">Test</Name></SchemeName>
+<SchemeInformationURI><URI xml:lang="en">http://test.ee</URI></SchemeInformationURI>
+<StatusDeterminationApproach>http://uri.etsi.org/TrstSvc/TrustedList/StatusDetn/EUappropriate</StatusDeterminationApproach>
+<SchemeTypeCommunityRules><URI xml:lang="en">http://uri.etsi.org/TrstSvc/TrustedList/schemerules/EUcommon</URI></SchemeTypeCommunityRules>
+<SchemeTerritory>EE</SchemeTerritory>
+<PolicyOrLegalNotice><TSLLegalNotice xml:lang="en">Test</TSLLegalNotice></PolicyOrLegalNotice>
+<HistoricalInformationPeriod>65535</HistoricalInformationPeriod>
+<ListIssueDateTime>2020-01-01T00:00:00Z</ListIssueDateTime>
+<NextUpdate><dateTime>2099-01-01T00:00:00Z</dateTime></NextUpdate>
+</SchemeInformation><TrustServiceProviderList><TrustServiceProvider>
+<TSPInformation><TSPName><Name xml:lang="en">Test</Name></TSPName><TSPAddress>)" + address + R"(</TSPAddress>
+<TSPInformationURI><URI xml:lang="en">http://test.ee</URI></TSPInformationURI></TSPInformation><TSPServices>)" +
+        service("Other CA", other) + service("No SKI CA", ca) +
+        "</TSPServices></TrustServiceProvider></TrustServiceProviderList></TrustServiceStatusList>";
+
+    // Sign list with enveloped signature
+    auto doc = make_unique_ptr<xmlFreeDoc>(xmlReadMemory(xml.c_str(), int(xml.size()), nullptr, nullptr, XML_PARSE_NONET));
+    BOOST_REQUIRE(doc);
+    xmlNodePtr signature = xmlSecTmplSignatureCreate(doc.get(), xmlSecTransformExclC14NId, xmlSecTransformRsaSha256Id, nullptr);
+    xmlAddChild(xmlDocGetRootElement(doc.get()), signature);
+    xmlNodePtr reference = xmlSecTmplSignatureAddReference(signature, xmlSecTransformSha256Id, nullptr, (const xmlChar*)"", nullptr);
+    xmlSecTmplReferenceAddTransform(reference, xmlSecTransformEnvelopedId);
+    xmlSecTmplReferenceAddTransform(reference, xmlSecTransformExclC14NId);
+    xmlSecTmplX509DataAddCertificate(xmlSecTmplKeyInfoAddX509Data(xmlSecTmplSignatureEnsureKeyInfo(signature, nullptr)));
+    auto ctx = make_unique_ptr<xmlSecDSigCtxDestroy>(xmlSecDSigCtxCreate(nullptr));
+    ctx->signKey = xmlSecKeyCreate();
+    EVP_PKEY_up_ref(tslKey.get());
+    xmlSecKeySetValue(ctx->signKey, xmlSecOpenSSLEvpKeyAdopt(tslKey.get()));
+    vector<unsigned char> tslDer = tslCert;
+    BOOST_REQUIRE(xmlSecOpenSSLAppKeyCertLoadMemory(ctx->signKey, tslDer.data(), tslDer.size(), xmlSecKeyDataFormatDer) == 0);
+    BOOST_REQUIRE(xmlSecDSigCtxSign(ctx.get(), signature) == 0);
+    BOOST_REQUIRE(xmlSaveFile("noski.tmp.xml", doc.get()) > 0);
+
+    struct NoSKIConfig: TestConfig
+    {
+        using TestConfig::TestConfig;
+        vector<X509Cert> TSLCerts() const override { return { cert }; }
+        X509Cert cert;
+    };
+    string path = dynamic_cast<const TestConfig*>(Conf::instance())->path;
+    digidoc::terminate();
+    auto *conf = new NoSKIConfig("noski.tmp.xml", string(path));
+    conf->cert = tslCert;
+    Conf::init(conf);
+    digidoc::initialize("untitestboost");
+    // Key lookup finds only other CA, issuer is found by subject name
+    BOOST_CHECK_NO_THROW(user.verify(true));
+
+    digidoc::terminate();
+    Conf::init(new TestConfig("TSL.xml", std::move(path)));
+    digidoc::initialize("untitestboost");
+    filesystem::remove("noski.tmp.xml");
+    filesystem::remove("noski.tmp.xml.snapshot");
+}
 BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE(X509CryptoSuite)
@@ -157,6 +301,41 @@ BOOST_AUTO_TEST_CASE(parameters)
 }
 BOOST_AUTO_TEST_SUITE_END()
 
+BOOST_AUTO_TEST_SUITE(DigestSuite)
+BOOST_AUTO_TEST_CASE(MultiDigestSinglePass)
+{
+    ifstream is("test1.txt", ifstream::binary);
+    MultiDigest calc({URI_SHA256, URI_SHA384, URI_SHA256, URI_SHA1});
+    BOOST_CHECK_NO_THROW(calc.update(is));
+    auto result = calc.result();
+    BOOST_CHECK_EQUAL(result.size(), 3U);
+    const vector<unsigned char> data {'1', '2', '3', '4', '\n'};
+    for(const char *uri: {URI_SHA1, URI_SHA256, URI_SHA384})
+        BOOST_CHECK_EQUAL(result[uri], Digest(uri).result(data));
+    BOOST_CHECK_THROW(MultiDigest({URI_SHA256, "unknown"}), Exception);
+}
+
+BOOST_AUTO_TEST_CASE(ContentDigestsFollowContent)
+{
+    ContentDigests digests;
+    string content = "1234\n";
+    auto calcDigest = [&] {
+        auto &cache = digests.current();
+        if(auto i = cache.find(URI_SHA256); i != cache.cend())
+            return i->second;
+        return cache[URI_SHA256] = Digest(URI_SHA256).result(vector<unsigned char>(content.cbegin(), content.cend()));
+    };
+    const vector<unsigned char> first = calcDigest();
+    digests.replaced(true);
+    BOOST_CHECK_EQUAL(digests.current().size(), 1U);
+    content = "changed";
+    digests.replaced();
+    BOOST_CHECK(digests.current().empty());
+    BOOST_CHECK(calcDigest() != first);
+    BOOST_CHECK_EQUAL(calcDigest(), Digest(URI_SHA256).result(vector<unsigned char>(content.cbegin(), content.cend())));
+}
+BOOST_AUTO_TEST_SUITE_END()
+
 BOOST_AUTO_TEST_SUITE(DocSuite)
 using DocTypes = boost::mpl::list<ASiCE>;
 BOOST_AUTO_TEST_CASE_TEMPLATE(constructor, Doc, DocTypes)
@@ -469,6 +648,16 @@ BOOST_AUTO_TEST_CASE(XmlConfCase) {
     const string testurl = "https://test.url";
     c.setVerifyServiceUri(testurl);
     BOOST_CHECK_EQUAL(c.verifyServiceUri(), testurl);
+    BOOST_CHECK_EQUAL(c.compressionLevel(), 9);
+    BOOST_CHECK(c.compressionProbe());
+    BOOST_CHECK(c.compressionSkipExtensions() == set<string>{"pdf"});
+    BOOST_CHECK(c.compressionSkipMediaTypes().contains("image/jpeg"));
+    BOOST_CHECK_EQUAL(c.TSLRefreshInterval(), 0);
+    BOOST_CHECK_EQUAL(c.threadPoolSize(), 0);
+    BOOST_CHECK(!c.OCSPCache());
+    BOOST_CHECK(c.OCSPCachePath().empty());
+    BOOST_CHECK_EQUAL(c.connectionPoolSize(), 0);
+    BOOST_CHECK_EQUAL(c.connectionIdleTimeout(), 30);
 }
 BOOST_AUTO_TEST_SUITE_END()
 
@@ -512,6 +701,58 @@ BOOST_AUTO_TEST_CASE(HexToBinConvertsHexEncodedStringToBinaryData)
 
     BOOST_CHECK_EQUAL(expectedDecodedData, result);
 }
+
+BOOST_AUTO_TEST_CASE(TempPathIsUniqueInSameDirectory)
+{
+    const string path = util::File::path("cache", "response.der");
+
+    string first = util::File::tempPath(path);
+    string second = util::File::tempPath(path);
+
+    BOOST_CHECK(first.starts_with(path + '.') && first.ends_with(".tmp"));
+    BOOST_CHECK(second.starts_with(path + '.') && second.ends_with(".tmp"));
+    BOOST_CHECK_NE(first, second);
+}
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(ThreadPoolSuite)
+BOOST_AUTO_TEST_CASE(WaitRunsOnlyOwnGroupTasks)
+{
+    util::ThreadPool pool(1);
+    promise<void> release;
+    util::ThreadPool::Group other(pool);
+    auto busy = other.submit([f = release.get_future().share()] { f.wait(); });
+    atomic<bool> otherRun = false;
+    auto queued = other.submit([&otherRun] { otherRun = true; });
+
+    util::ThreadPool::Group group(pool);
+    auto own = group.submit([] { return this_thread::get_id(); });
+    BOOST_CHECK_EQUAL(group.wait(own), this_thread::get_id());
+    BOOST_CHECK(!otherRun);
+
+    release.set_value();
+    other.wait(busy);
+    other.wait(queued);
+    BOOST_CHECK(otherRun);
+}
+
+BOOST_AUTO_TEST_CASE(GroupDestructorCompletesTasks)
+{
+    util::ThreadPool pool(1);
+    atomic<int> completed = 0;
+    {
+        util::ThreadPool::Group group(pool);
+        for(int i = 0; i < 3; ++i)
+        {
+            // Results are not waited, as when submitting scope is left by an exception
+            (void)group.submit([&completed] {
+                this_thread::sleep_for(chrono::milliseconds(50));
+                ++completed;
+            });
+        }
+    }
+    BOOST_CHECK_EQUAL(completed, 3);
+}
 BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE(ASiCETestSuite)
@@ -531,6 +772,494 @@ BOOST_AUTO_TEST_CASE(manifest_data_file_paths_are_supported)
     BOOST_CHECK_EQUAL(d->dataFiles().front()->fileName(), "folder/test1.txt");
 }
 
+BOOST_AUTO_TEST_CASE(stored_data_file_saved_in_place)
+{
+    // asice-path.asice contains STORED entries that are accessed directly from mapped file
+    filesystem::copy_file("asice-path.asice", "stored.tmp.asice", filesystem::copy_options::overwrite_existing);
+    auto d = Container::openPtr("stored.tmp.asice");
+    BOOST_REQUIRE_EQUAL(d->dataFiles().size(), 1U);
+    const vector<unsigned char> sha256 = Digest(URI_SHA256).result({'d', 'a', 't', 'a'});
+    BOOST_CHECK_EQUAL(d->dataFiles().front()->fileSize(), 4U);
+    BOOST_CHECK_EQUAL(d->dataFiles().front()->calcDigest(URI_SHA256), sha256);
+    BOOST_CHECK_NO_THROW(d->save());
+    BOOST_CHECK_EQUAL(d->dataFiles().front()->calcDigest(URI_SHA256), sha256);
+
+    d = Container::openPtr("stored.tmp.asice");
+    BOOST_REQUIRE_EQUAL(d->dataFiles().size(), 1U);
+    BOOST_CHECK_EQUAL(d->dataFiles().front()->calcDigest(URI_SHA256), sha256);
+}
+
+BOOST_AUTO_TEST_CASE(compressed_data_file_read_on_demand)
+{
+    auto d = Container::createPtr("lazy.tmp.asice");
+    BOOST_CHECK_NO_THROW(d->addDataFile("test1.txt", "text/plain"));
+    BOOST_CHECK_NO_THROW(d->save());
+    const vector<unsigned char> sha256 = d->dataFiles().front()->calcDigest(URI_SHA256);
+
+    d = Container::openPtr("lazy.tmp.asice");
+    BOOST_REQUIRE_EQUAL(d->dataFiles().size(), 1U);
+    BOOST_CHECK_EQUAL(d->dataFiles().front()->fileSize(), 5U);
+    BOOST_CHECK_EQUAL(d->dataFiles().front()->calcDigest(URI_SHA256), sha256);
+    BOOST_CHECK_EQUAL(d->dataFiles().front()->calcDigest(URI_SHA256), sha256);
+    stringstream s;
+    BOOST_CHECK_NO_THROW(d->dataFiles().front()->saveAs(s));
+    BOOST_CHECK_EQUAL(s.str(), "1234\n");
+    BOOST_CHECK_NO_THROW(d->save());
+    BOOST_CHECK_EQUAL(d->dataFiles().front()->calcDigest(URI_SHA256), sha256);
+}
+
+BOOST_AUTO_TEST_CASE(compressed_data_file_digested_in_one_read)
+{
+    string data;
+    for(size_t i = 0; data.size() < 100000; ++i)
+        data += to_string(i) + ' ';
+    auto d = Container::createPtr("digested.tmp.asice");
+    BOOST_CHECK_NO_THROW(d->addDataFile(make_unique<stringstream>(data), "large.txt", "text/plain"));
+    BOOST_CHECK_NO_THROW(d->addDataFile("test1.txt", "text/plain"));
+    BOOST_CHECK_NO_THROW(d->save());
+
+    d = Container::openPtr("digested.tmp.asice");
+    BOOST_REQUIRE_EQUAL(d->dataFiles().size(), 2U);
+    Metrics::reset();
+    Metrics::setEnabled(true);
+    for(DataFile *file: d->dataFiles())
+    {
+        stringstream s;
+        BOOST_CHECK_NO_THROW(file->saveAs(s));
+        BOOST_CHECK_NO_THROW(file->calcDigest(URI_SHA256));
+        BOOST_CHECK_NO_THROW(file->calcDigest(URI_SHA256));
+    }
+    Metrics m = Metrics::snapshot();
+    Metrics::setEnabled(false);
+    Metrics::reset();
+    // Whole entry is buffered for small file, large file is decompressed again for the digest
+    BOOST_CHECK_EQUAL(m.zipInflatedBytes, 2 * data.size() + 5);
+    BOOST_CHECK_EQUAL(m.digestBytes, data.size() + 5);
+}
+
+BOOST_AUTO_TEST_CASE(referenced_digest_calculated_once_on_validation)
+{
+    string data;
+    for(size_t i = 0; data.size() < 100000; ++i)
+        data += to_string(i) + ' ';
+    {
+        auto d = Container::createPtr("validated.tmp.asice");
+        BOOST_CHECK_NO_THROW(d->addDataFile(make_unique<stringstream>(data), "large.txt", "text/plain"));
+        PKCS12Signer signer("signer1.p12", "signer1");
+        signer.setProfile("BES");
+        BOOST_CHECK_NO_THROW(d->sign(&signer));
+        BOOST_CHECK_NO_THROW(d->save());
+    }
+    {
+        // Trust lists may be loaded on first validation
+        auto d = Container::openPtr("validated.tmp.asice");
+        BOOST_REQUIRE_EQUAL(d->signatures().size(), 1U);
+        Signature::Validator v(d->signatures().front());
+    }
+    auto d = Container::openPtr("validated.tmp.asice");
+    BOOST_REQUIRE_EQUAL(d->signatures().size(), 1U);
+    X509Cert cert = d->signatures().front()->signingCertificate();
+    Metrics::reset();
+    Metrics::setEnabled(true);
+    Signature::Validator v(d->signatures().front());
+    Metrics m = Metrics::snapshot();
+    Metrics::setEnabled(false);
+    Metrics::reset();
+    // One SHA-256 pass by reference verification and signing certificate digest
+    BOOST_CHECK_EQUAL(m.zipInflatedBytes, data.size());
+    BOOST_CHECK_EQUAL(m.digestBytes, data.size() + vector<unsigned char>(cert).size());
+}
+
+BOOST_AUTO_TEST_CASE(compressed_data_file_source_replaced)
+{
+    auto d = Container::createPtr("replaced.tmp.asice");
+    BOOST_CHECK_NO_THROW(d->addDataFile("test1.txt", "text/plain"));
+    BOOST_CHECK_NO_THROW(d->save());
+    const vector<unsigned char> sha256 = d->dataFiles().front()->calcDigest(URI_SHA256);
+
+    d = Container::openPtr("replaced.tmp.asice");
+    BOOST_REQUIRE_EQUAL(d->dataFiles().size(), 1U);
+    auto other = Container::createPtr("replacement.tmp.asice");
+    BOOST_CHECK_NO_THROW(other->addDataFile(make_unique<stringstream>("changed"), "test1.txt", "text/plain"));
+    BOOST_CHECK_NO_THROW(other->save());
+    other.reset();
+    filesystem::rename("replacement.tmp.asice", "replaced.tmp.asice");
+    BOOST_CHECK_EQUAL(d->dataFiles().front()->calcDigest(URI_SHA256), sha256);
+    filesystem::remove("replaced.tmp.asice");
+    stringstream s;
+    BOOST_CHECK_NO_THROW(d->dataFiles().front()->saveAs(s));
+    BOOST_CHECK_EQUAL(s.str(), "1234\n");
+}
+
+BOOST_AUTO_TEST_CASE(referenced_digest_calculated_on_read)
+{
+    auto d = Container::openPtr("test.asice");
+    BOOST_REQUIRE(d && d->dataFiles().size() == 1U);
+    Metrics::reset();
+    Metrics::setEnabled(true);
+    stringstream s;
+    BOOST_CHECK_NO_THROW(d->dataFiles().front()->saveAs(s));
+    BOOST_CHECK_EQUAL(d->dataFiles().front()->calcDigest(URI_SHA256), vector<unsigned char>({
+        0xA8, 0x83, 0xDA, 0xFC, 0x48, 0x0D, 0x46, 0x6E, 0xE0, 0x4E, 0x0D, 0x6D, 0xA9, 0x86, 0xBD, 0x78,
+        0xEB, 0x1F, 0xDD, 0x21, 0x78, 0xD0, 0x46, 0x93, 0x72, 0x3D, 0xA3, 0xA8, 0xF9, 0x5D, 0x42, 0xF4}));
+    // Referenced digest was calculated while saveAs decompressed the entry
+    Metrics m = Metrics::snapshot();
+    Metrics::setEnabled(false);
+    Metrics::reset();
+    BOOST_CHECK_EQUAL(m.zipInflatedBytes, d->dataFiles().front()->fileSize());
+    BOOST_CHECK_EQUAL(m.caches["dataFileDigest"].hits, 1U);
+    BOOST_CHECK_EQUAL(m.caches["dataFileDigest"].misses, 0U);
+    BOOST_CHECK_EQUAL(d->dataFiles().front()->calcDigest(URI_SHA512), Digest(URI_SHA512).result(
+        vector<unsigned char>(istreambuf_iterator<char>(s), {})));
+}
+
+BOOST_AUTO_TEST_CASE(signatures_validated_concurrently)
+{
+    auto d = Container::createPtr("validate.tmp.asice");
+    BOOST_CHECK_NO_THROW(d->addDataFile("test1.txt", "text/plain"));
+    BOOST_CHECK_NO_THROW(d->addDataFile(make_unique<stringstream>(string(100000, 'a')), "large.txt", "text/plain"));
+    for(const char *name: {"signer1", "signer2", "signer3", "signer1"})
+    {
+        PKCS12Signer signer(string(name) + ".p12", name);
+        signer.setProfile("BES");
+        BOOST_CHECK_NO_THROW(d->sign(&signer));
+    }
+    BOOST_CHECK_NO_THROW(d->save());
+
+    d = Container::openPtr("validate.tmp.asice");
+    BOOST_REQUIRE_EQUAL(d->signatures().size(), 4U);
+    auto result = d->validateAll();
+    BOOST_REQUIRE_EQUAL(result.size(), 4U);
+    for(size_t i = 0; i < result.size(); ++i)
+    {
+        Signature::Validator v(d->signatures()[i]);
+        BOOST_CHECK_EQUAL(result[i]->status(), v.status());
+        BOOST_CHECK_EQUAL(result[i]->diagnostics(), v.diagnostics());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(signatures_from_territories_validated_concurrently)
+{
+    auto d = Container::createPtr("territories.tmp.asice");
+    BOOST_CHECK_NO_THROW(d->addDataFile("test1.txt", "text/plain"));
+    for(const char *name: {"signerLV", "signerLT", "signer1", "signerLT"})
+    {
+        PKCS12Signer signer(string(name) + ".p12", name);
+        signer.setProfile("BES");
+        BOOST_CHECK_NO_THROW(d->sign(&signer));
+    }
+    BOOST_CHECK_NO_THROW(d->save());
+
+    // Territory lists are activated and loaded from worker threads
+    filesystem::remove("LV.xml");
+    filesystem::remove("LT.xml");
+    d = Container::openPtr("territories.tmp.asice");
+    BOOST_REQUIRE_EQUAL(d->signatures().size(), 4U);
+    auto result = d->validateAll();
+    BOOST_REQUIRE_EQUAL(result.size(), 4U);
+    BOOST_CHECK(filesystem::exists("LV.xml"));
+    BOOST_CHECK(filesystem::exists("LT.xml"));
+    for(size_t i = 0; i < result.size(); ++i)
+    {
+        Signature::Validator v(d->signatures()[i]);
+        BOOST_CHECK_EQUAL(result[i]->status(), v.status());
+        BOOST_CHECK_EQUAL(result[i]->diagnostics(), v.diagnostics());
+    }
+    filesystem::remove("LV.xml");
+    filesystem::remove("LT.xml");
+}
+
+BOOST_AUTO_TEST_CASE(territory_activated_during_refresh)
+{
+    struct RefreshConfig: TestConfig
+    {
+        using TestConfig::TestConfig;
+        int TSLRefreshInterval() const override { return 3600; }
+    };
+    string path = dynamic_cast<const TestConfig*>(Conf::instance())->path;
+    {
+        auto d = Container::createPtr("refresh.tmp.asice");
+        BOOST_CHECK_NO_THROW(d->addDataFile("test1.txt", "text/plain"));
+        PKCS12Signer signer("signerLV.p12", "signerLV");
+        signer.setProfile("BES");
+        BOOST_CHECK_NO_THROW(d->sign(&signer));
+        BOOST_CHECK_NO_THROW(d->save());
+    }
+    filesystem::remove("LV.xml");
+
+    digidoc::terminate();
+    Conf::init(new RefreshConfig("TSL.xml", string(path)));
+    static atomic<int> refreshed = 0;
+    digidoc::initialize("untitestboost", [](const Exception *) { ++refreshed; });
+    for(int i = 0; i < 100 && refreshed == 0; ++i)
+        this_thread::sleep_for(chrono::milliseconds(100));
+    BOOST_CHECK_EQUAL(refreshed, 1);
+    {
+        auto d = Container::openPtr("refresh.tmp.asice");
+        BOOST_REQUIRE_EQUAL(d->signatures().size(), 1U);
+        Signature::Validator v(d->signatures().front());
+        // Validation does not wait for refresher, territory is reported as not loaded
+        BOOST_CHECK(v.diagnostics().find("not loaded yet") != string::npos);
+        for(int i = 0; i < 100 && refreshed < 2; ++i)
+            this_thread::sleep_for(chrono::milliseconds(100));
+        BOOST_CHECK_EQUAL(refreshed, 2);
+        BOOST_CHECK(filesystem::exists("LV.xml"));
+        Signature::Validator v2(d->signatures().front());
+        BOOST_CHECK(v2.diagnostics().find("not loaded yet") == string::npos);
+    }
+
+    digidoc::terminate();
+    Conf::init(new TestConfig("TSL.xml", std::move(path)));
+    digidoc::initialize("untitestboost");
+    filesystem::remove("LV.xml");
+}
+
+BOOST_AUTO_TEST_CASE(validation_checks_reported)
+{
+    auto d = Container::openPtr("forged_lt.asice");
+    // Signature schema is compiled once per process
+    d = Container::openPtr("forged_lt.asice");
+    BOOST_REQUIRE(d && !d->signatures().empty());
+    Signature::Validator v(d->signatures().front());
+    map<string,Signature::Validator::Check> checks;
+    for(const auto &check: v.checks())
+        checks.emplace(check.name, check);
+    for(const char *name: {"schema", "properties", "references", "signingCertificate", "timestamp", "ocsp"})
+        BOOST_CHECK_MESSAGE(checks.contains(name), name);
+    BOOST_CHECK(checks["schema"].status == Signature::Validator::Valid);
+    BOOST_CHECK_EQUAL(ranges::count(checks["schema"].cacheHits, "schema"), 1);
+    BOOST_CHECK(checks["references"].status == Signature::Validator::Invalid);
+    BOOST_CHECK(checks["references"].elapsed.count() > 0);
+    BOOST_CHECK(v.report().find(R"({"name":"references","status":"Invalid","code":"General")") != string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(metrics_counted)
+{
+    Metrics::reset();
+    Metrics::setEnabled(true);
+    auto d = Container::createPtr("metrics.tmp.asice");
+    BOOST_CHECK_NO_THROW(d->addDataFile("test1.txt", "text/plain"));
+    BOOST_CHECK_NO_THROW(d->save());
+    d = Container::openPtr("metrics.tmp.asice");
+    BOOST_REQUIRE_EQUAL(d->dataFiles().size(), 1U);
+    d->dataFiles().front()->calcDigest(URI_SHA256);
+    d->dataFiles().front()->calcDigest(URI_SHA256);
+    Metrics m = Metrics::snapshot();
+    Metrics::setEnabled(false);
+    BOOST_CHECK(m.zipDeflatedBytes > 0);
+    BOOST_CHECK(m.zipInflatedBytes > 0);
+    BOOST_CHECK(m.digestBytes >= 5);
+    BOOST_CHECK_EQUAL(m.caches["dataFileDigest"].hits, 1U);
+    Metrics::reset();
+    BOOST_CHECK_EQUAL(Metrics::snapshot().digestBytes, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(failed_requests_counted)
+{
+    Metrics::reset();
+    Metrics::setEnabled(true);
+    BOOST_CHECK_THROW(Connect("http://127.0.0.1:1/", "GET", 1).exec(), Exception);
+#ifndef _WIN32
+    // Serves one canned response per connection and closes it
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(addr);
+    BOOST_REQUIRE(bind(server, (sockaddr*)&addr, size) == 0 && listen(server, 4) == 0);
+    getsockname(server, (sockaddr*)&addr, &size);
+    thread serve([server] {
+        for(string_view response: {
+                "HTTP/1.0 200 OK\r\n\r\nclose delimited",
+                "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nabc",
+                "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"})
+        {
+            int client = accept(server, nullptr, nullptr);
+            string request(4096, 0);
+            BOOST_CHECK(recv(client, request.data(), request.size(), 0) > 0);
+            BOOST_CHECK(send(client, response.data(), response.size(), 0) == ssize_t(response.size()));
+            close(client);
+        }
+    });
+    string url = "http://127.0.0.1:" + to_string(ntohs(addr.sin_port)) + "/";
+    Connect::Result r;
+    BOOST_CHECK_NO_THROW(r = Connect(url, "GET", 5).exec());
+    BOOST_CHECK_EQUAL(r.content, "close delimited");
+    BOOST_CHECK_NO_THROW(Connect(url, "GET", 5).exec());
+    BOOST_CHECK_NO_THROW(Connect(url, "GET", 5).exec());
+    serve.join();
+    close(server);
+#endif
+    Metrics m = Metrics::snapshot();
+    Metrics::setEnabled(false);
+    Metrics::reset();
+#ifndef _WIN32
+    BOOST_CHECK_EQUAL(m.hosts["127.0.0.1"].requests, 4U);
+    BOOST_CHECK_EQUAL(m.hosts["127.0.0.1"].failures, 3U);
+#else
+    BOOST_CHECK_EQUAL(m.hosts["127.0.0.1"].requests, 1U);
+    BOOST_CHECK_EQUAL(m.hosts["127.0.0.1"].failures, 1U);
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(untrusted_cached_ocsp_response_requested_again)
+{
+    struct OCSPCacheConfig: TestConfig
+    {
+        using TestConfig::TestConfig;
+        bool OCSPCache() const override { return true; }
+        string OCSPCachePath() const override { return util::File::path(path, "ocsp.tmp"); }
+    };
+    string path = dynamic_cast<const TestConfig*>(Conf::instance())->path;
+    Conf::init(new OCSPCacheConfig("TSL.xml", string(path)));
+
+    // Forge fresh response for signer1 that is signed by untrusted signer2
+    PKCS12Signer signer("signer1.p12", "signer1");
+    signer.setProfile("time-stamp");
+    X509Cert issuer("inter.crt", X509Cert::Pem);
+    auto p12 = make_unique_ptr<PKCS12_free>([] {
+        auto bio = make_unique_ptr<BIO_free>(BIO_new_file("signer2.p12", "rb"));
+        return d2i_PKCS12_bio(bio.get(), nullptr);
+    }());
+    EVP_PKEY *key {};
+    X509 *cert {};
+    BOOST_REQUIRE(p12 && PKCS12_parse(p12.get(), "signer2", &key, &cert, nullptr));
+    auto keyPtr = make_unique_ptr<EVP_PKEY_free>(key);
+    auto certPtr = make_unique_ptr<X509_free>(cert);
+    auto certId = make_unique_ptr<OCSP_CERTID_free>(OCSP_cert_to_id(nullptr, signer.cert().handle(), issuer.handle()));
+    auto basic = make_unique_ptr<OCSP_BASICRESP_free>(OCSP_BASICRESP_new());
+    auto thisUpdate = make_unique_ptr<ASN1_TIME_free>(ASN1_GENERALIZEDTIME_set(nullptr, time(nullptr)));
+    BOOST_REQUIRE(OCSP_basic_add1_status(basic.get(), certId.get(), V_OCSP_CERTSTATUS_GOOD, 0, nullptr, thisUpdate.get(), nullptr));
+    BOOST_REQUIRE(OCSP_basic_sign(basic.get(), cert, key, EVP_sha256(), nullptr, 0) == 1);
+    // Produced after time-stamp to be usable for the signature
+    ASN1_GENERALIZEDTIME_set(const_cast<ASN1_GENERALIZEDTIME*>(OCSP_resp_get0_produced_at(basic.get())), time(nullptr) + 300);
+    auto resp = make_unique_ptr<OCSP_RESPONSE_free>(OCSP_response_create(OCSP_RESPONSE_STATUS_SUCCESSFUL, basic.get()));
+    vector<unsigned char> forged = i2d<i2d_OCSP_RESPONSE>(resp);
+
+    string url = "http://demo.sk.ee/ocsp";
+    vector<unsigned char> data = i2d<i2d_OCSP_CERTID>(certId);
+    data.insert(data.begin(), url.cbegin(), url.cend());
+    string name;
+    for(unsigned char c: Digest(URI_SHA256).result(data))
+        name += Log::format("%02x", c);
+    string file = util::File::path(util::File::path(path, "ocsp.tmp"), name + ".der");
+    filesystem::create_directories(util::File::path(path, "ocsp.tmp"));
+    ofstream(file, ofstream::binary).write((const char*)forged.data(), streamsize(forged.size()));
+
+    auto sign = [&signer](const string &name) {
+        Metrics::reset();
+        Metrics::setEnabled(true);
+        auto d = Container::createPtr(name);
+        BOOST_CHECK_NO_THROW(d->addDataFile("test1.txt", "text/plain"));
+        BOOST_CHECK_NO_THROW(d->sign(&signer));
+        if(!d->signatures().empty())
+            BOOST_CHECK_NO_THROW(d->signatures().front()->validate());
+        Metrics m = Metrics::snapshot();
+        Metrics::setEnabled(false);
+        Metrics::reset();
+        return m;
+    };
+    // Cache miss, forged response is replaced with response from responder
+    Metrics m = sign("ocspcache1.tmp.asice");
+    BOOST_CHECK_EQUAL(m.caches["ocspResponse"].hits, 0U);
+    BOOST_CHECK_EQUAL(m.caches["ocspResponse"].misses, 1U);
+    BOOST_CHECK_EQUAL(m.ocspRequests, 1U);
+    ifstream is(file, ifstream::binary);
+    vector<unsigned char> stored{istreambuf_iterator<char>(is), istreambuf_iterator<char>()};
+    BOOST_CHECK(!stored.empty() && stored != forged);
+
+    // Response is reused only when it is produced after time-stamp, hit does not make request
+    m = sign("ocspcache2.tmp.asice");
+    BOOST_CHECK_EQUAL(m.caches["ocspResponse"].hits + m.caches["ocspResponse"].misses, 1U);
+    BOOST_CHECK_EQUAL(m.ocspRequests, m.caches["ocspResponse"].misses);
+
+    filesystem::remove_all(util::File::path(path, "ocsp.tmp"));
+    Conf::init(new TestConfig("TSL.xml", std::move(path)));
+}
+
+BOOST_AUTO_TEST_CASE(ocsp_requested_after_time_stamp)
+{
+    struct RefusedTSAConfig: TestConfig
+    {
+        using TestConfig::TestConfig;
+        string TSUrl() const override { return "http://127.0.0.1:1/"; }
+    };
+    PKCS12Signer signer("signer1.p12", "signer1");
+    signer.setProfile("time-stamp");
+    auto sign = [&signer] {
+        Metrics::reset();
+        Metrics::setEnabled(true);
+        auto d = Container::createPtr("ocsp-after-ts.tmp.asice");
+        BOOST_CHECK_NO_THROW(d->addDataFile("test1.txt", "text/plain"));
+        try {
+            d->sign(&signer);
+        } catch(const Exception &) {}
+        Metrics m = Metrics::snapshot();
+        Metrics::setEnabled(false);
+        Metrics::reset();
+        return m;
+    };
+    // Response produced before time-stamp is not usable, status is not requested without time-stamp
+    string path = dynamic_cast<const TestConfig*>(Conf::instance())->path;
+    Conf::init(new RefusedTSAConfig("TSL.xml", string(path)));
+    Metrics m = sign();
+    Conf::init(new TestConfig("TSL.xml", std::move(path)));
+    BOOST_CHECK_EQUAL(m.tsaRequests, 1U);
+    BOOST_CHECK_EQUAL(m.ocspRequests, 0U);
+
+    // Single OCSP request after time-stamp
+    m = sign();
+    BOOST_CHECK_EQUAL(m.tsaRequests, 1U);
+    BOOST_CHECK_EQUAL(m.ocspRequests, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(data_files_compressed_in_chunks)
+{
+    // Larger than a single compression chunk
+    string data;
+    for(size_t i = 0; data.size() < 1000000; ++i)
+        data += to_string(i * i) + ' ';
+    auto d = Container::createPtr("chunks.tmp.asice");
+    BOOST_CHECK_NO_THROW(d->addDataFile(make_unique<stringstream>(data), "large.txt", "text/plain"));
+    BOOST_CHECK_NO_THROW(d->addDataFile(make_unique<stringstream>(), "empty.txt", "text/plain"));
+    BOOST_CHECK_NO_THROW(d->addDataFile("test1.txt", "text/plain"));
+    BOOST_CHECK_NO_THROW(d->save());
+
+    d = Container::openPtr("chunks.tmp.asice");
+    BOOST_REQUIRE_EQUAL(d->dataFiles().size(), 3U);
+    for(const auto &[file, content]: {pair{0U, data}, pair{1U, string()}, pair{2U, string("1234\n")}})
+    {
+        stringstream s;
+        BOOST_CHECK_NO_THROW(d->dataFiles()[file]->saveAs(s));
+        BOOST_CHECK(s.str() == content);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compressed_data_files_stored)
+{
+    string text;
+    for(size_t i = 0; text.size() < 100000; ++i)
+        text += to_string(i) + ' ';
+    string random(100000, 0);
+    mt19937 gen;
+    generate(random.begin(), random.end(), [&gen] { return char(gen()); });
+    auto size = [](const string &data, const string &name, const string &mediaType) {
+        auto d = Container::createPtr("compression.tmp.asice");
+        BOOST_CHECK_NO_THROW(d->addDataFile(make_unique<stringstream>(data), name, mediaType));
+        BOOST_CHECK_NO_THROW(d->save());
+        d = Container::openPtr("compression.tmp.asice");
+        stringstream s;
+        BOOST_CHECK_NO_THROW(d->dataFiles().front()->saveAs(s));
+        BOOST_CHECK(s.str() == data);
+        return filesystem::file_size("compression.tmp.asice");
+    };
+    BOOST_CHECK_LT(size(text, "text.txt", "text/plain"), text.size() / 2);
+    // Skipped by extension, media type and entropy probe
+    BOOST_CHECK_GT(size(text, "text.PDF", "application/octet-stream"), text.size());
+    BOOST_CHECK_GT(size(text, "text.bin", "image/jpeg"), text.size());
+    BOOST_CHECK_GT(size(random, "random.bin", "application/octet-stream"), random.size());
+}
+
 BOOST_AUTO_TEST_CASE(manifest_data_file_relative_paths_are_rejected)
 {
     BOOST_CHECK_THROW(Container::openPtr("asice-relative.asice"), Exception);
@@ -646,6 +1375,59 @@ BOOST_AUTO_TEST_CASE(ThrowsWithNoSignatures)
     BOOST_CHECK_THROW(Container::extendContainerValidity(*d, &signer, extendedCount), Exception);
 }
 
+BOOST_AUTO_TEST_CASE(ExtendSignatureProfilesBatch)
+{
+    struct RefusedTSAConfig: TestConfig
+    {
+        using TestConfig::TestConfig;
+        string TSUrl() const override { return "http://127.0.0.1:1/"; }
+    };
+    PKCS12Signer signer("signer1.p12", "signer1");
+    signer.setProfile("BES");
+    vector<unique_ptr<Container>> docs;
+    vector<Signature*> signatures;
+    for(const char *name: {"batch1.tmp.asice", "batch2.tmp.asice"})
+    {
+        auto &d = docs.emplace_back(Container::createPtr(name));
+        BOOST_CHECK_NO_THROW(d->addDataFile("test1.txt", "text/plain"));
+        BOOST_CHECK_NO_THROW(d->sign(&signer));
+        BOOST_CHECK_NO_THROW(d->sign(&signer));
+        for(Signature *s: d->signatures())
+            signatures.push_back(s);
+    }
+    BOOST_REQUIRE_EQUAL(signatures.size(), 4U);
+    BOOST_CHECK_THROW(Container::extendSignatureProfiles(signatures, nullptr), Exception);
+    signer.setProfile("time-stamp");
+
+    // Every failed signature is reported and left unchanged
+    string path = dynamic_cast<const TestConfig*>(Conf::instance())->path;
+    Conf::init(new RefusedTSAConfig("TSL.xml", string(path)));
+    try {
+        Container::extendSignatureProfiles(signatures, &signer);
+        BOOST_ERROR("Exception expected");
+    } catch(const Exception &e) {
+        BOOST_REQUIRE_EQUAL(e.causes().size(), signatures.size());
+        set<string> failed;
+        for(const Exception &cause: e.causes())
+        {
+            failed.insert(cause.msg());
+            BOOST_CHECK(!cause.causes().empty());
+        }
+        for(Signature *s: signatures)
+            BOOST_CHECK(failed.contains("Failed to extend signature '" + s->id() + "'"));
+    }
+    Conf::init(new TestConfig("TSL.xml", std::move(path)));
+    for(Signature *s: signatures)
+        BOOST_CHECK_EQUAL(s->profile(), "BES");
+
+    BOOST_CHECK_NO_THROW(Container::extendSignatureProfiles(signatures, &signer));
+    for(Signature *s: signatures)
+    {
+        BOOST_CHECK_EQUAL(s->profile(), "BES/time-stamp");
+        BOOST_CHECK_NO_THROW(s->validate());
+    }
+}
+
 BOOST_AUTO_TEST_CASE(ExtendAsiceInPlace)
 {
     // Sign with TS profile, extend in place to TSA